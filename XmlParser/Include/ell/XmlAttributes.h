@@ -0,0 +1,177 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLATTRIBUTES_H
+#define INCLUDED_ELL_XMLATTRIBUTES_H
+
+#include <ell/XmlName.h>
+
+namespace ell
+{
+    //@{
+    /// String conversions used to copy attributes between containers
+    inline void xml_assign(std::string & to, const std::string & from) { to = from; }
+    inline void xml_assign(std::string & to, const ell::string & from) { to.assign(from.position, from.size()); }
+    inline void xml_assign(ell::string & to, const ell::string & from) { to = from; }
+    inline void xml_assign(ell::string & to, const std::string & from) { to = ell::string(from); }
+    //@}
+
+    /// Flat, insertion-ordered attribute container
+    ///
+    /// The N first attributes are stored inline, so that the usual handful of
+    /// attributes of an element costs no allocation. Lookup is linear, which beats
+    /// a tree on such small sizes. The interface is the subset of std::map used on
+    /// attributes.
+    template <typename Name, typename Value, const int N>
+    struct XmlAttributeList
+    {
+        typedef std::pair<Name, Value> value_type;
+        typedef value_type * iterator;
+        typedef const value_type * const_iterator;
+
+        XmlAttributeList()
+          : data(inline_data), size_(0), capacity(N)
+        { }
+
+        XmlAttributeList(const XmlAttributeList & other)
+          : data(inline_data), size_(0), capacity(N)
+        {
+            assign(other);
+        }
+
+        ~XmlAttributeList()
+        {
+            if (data != inline_data)
+                delete [] data;
+        }
+
+        XmlAttributeList & operator = (const XmlAttributeList & other)
+        {
+            if (this != & other)
+                assign(other);
+            return * this;
+        }
+
+        /// Copy any attribute container, converting strings if needed
+        template <typename Other>
+        void assign(const Other & other)
+        {
+            clear();
+            reserve(other.size());
+            for (typename Other::const_iterator i = other.begin(); i != other.end(); ++i)
+            {
+                value_type & a = data[size_++];
+                xml_assign(a.first, i->first);
+                xml_assign(a.second, i->second);
+            }
+        }
+
+        iterator begin() { return data; }
+        iterator end() { return data + size_; }
+        const_iterator begin() const { return data; }
+        const_iterator end() const { return data + size_; }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        /// Storage is kept for reuse
+        void clear() { size_ = 0; }
+
+        iterator find(const ell::string & name)
+        {
+            iterator i = data, e = end();
+            while (i != e && ! (i->first == name))
+                ++i;
+            return i;
+        }
+
+        const_iterator find(const ell::string & name) const
+        {
+            return const_cast<XmlAttributeList *>(this)->find(name);
+        }
+
+        /// Lookup by interned name, with integer comparisons for XmlName keys
+        /// of the same table
+        iterator find(const XmlName & name)
+        {
+            iterator i = data, e = end();
+            while (i != e && ! (i->first == name))
+                ++i;
+            return i;
+        }
+
+        const_iterator find(const XmlName & name) const
+        {
+            return const_cast<XmlAttributeList *>(this)->find(name);
+        }
+
+        /// Return the value of the given attribute, appending it if it does not exist
+        Value & operator [] (const ell::string & name)
+        {
+            iterator i = find(name);
+            if (i == end())
+            {
+                i = append();
+                xml_assign(i->first, name);
+                i->second = Value();
+            }
+            return i->second;
+        }
+
+        /// Append an attribute without checking whether it already exists
+        void push_back(const Name & name, const Value & value)
+        {
+            iterator i = append();
+            i->first = name;
+            i->second = value;
+        }
+
+        /// Remove the given attribute, keeping the order of the other ones
+        void erase(iterator i)
+        {
+            for (iterator e = end() - 1; i != e; ++i)
+                std::swap(* i, * (i + 1));
+            --size_;
+        }
+
+        void reserve(size_t n)
+        {
+            if (n <= capacity)
+                return;
+
+            value_type * d = new value_type[n];
+            for (size_t i = 0; i < size_; ++i)
+                std::swap(d[i], data[i]);
+            if (data != inline_data)
+                delete [] data;
+            data = d;
+            capacity = n;
+        }
+
+    private:
+        iterator append()
+        {
+            if (size_ == capacity)
+                reserve(capacity * 2);
+            return data + size_++;
+        }
+
+        value_type * data;
+        size_t size_, capacity;
+        value_type inline_data[N];
+    };
+}
+
+#endif // INCLUDED_ELL_XMLATTRIBUTES_H
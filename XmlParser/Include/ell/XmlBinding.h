@@ -0,0 +1,301 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_XMLBINDING_H
+#define INCLUDED_ELL_XMLBINDING_H
+
+#include <vector>
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Type independent part of XmlBinding: dispatch tables from element and
+    /// attribute names to members
+    ///
+    /// Each binding interns its names in its own tables, so that the id of
+    /// a name found there directly indexes the members. Ids are not dense,
+    /// the parts of prefixed names being interned too: their slots are null.
+    /// Bindings are only
+    /// read while parsing, and may be shared by parsers of several threads.
+    struct XmlBindingBase
+    {
+        /// Conversion of a text to a member of an object
+        struct Setter
+        {
+            virtual ~Setter() { }
+            virtual bool set(void * object, const char * begin, const char * end) const = 0;
+        };
+
+        /// Child element, bound to a member of the parent object
+        struct Child
+        {
+            Child(const XmlBindingBase * binding)
+              : binding(binding)
+            { }
+
+            virtual ~Child() { }
+
+            /// Return the object to fill from a new child element
+            virtual void * enter(void * parent) const = 0;
+
+            const XmlBindingBase * binding;
+        };
+
+        XmlBindingBase()
+          : text_setter(0)
+        { }
+
+        virtual ~XmlBindingBase();
+
+        //@{
+        /// Return null for unbound names
+        const Child * find_child(const ell::string & name) const
+        {
+            uint32_t id = element_names.find(name).id();
+            return id && id <= children.size() ? children[id - 1] : 0;
+        }
+
+        const Setter * find_attribute(const ell::string & name) const
+        {
+            uint32_t id = attribute_names.find(name).id();
+            return id && id <= attributes.size() ? attributes[id - 1] : 0;
+        }
+        //@}
+
+        /// Conversion of the element text, if bound
+        const Setter * text_setter;
+
+    protected:
+        //@{
+        /// Take ownership of the given objects
+        void add_child(const std::string & name, Child * child);
+        void add_attribute(const std::string & name, Setter * setter);
+        void set_text(Setter * setter);
+
+        template <typename B>
+        const B * own(B * binding)
+        {
+            owned.push_back(binding);
+            return binding;
+        }
+        //@}
+
+    private:
+        XmlNameTable element_names, attribute_names;
+        std::vector<Child *> children;
+        std::vector<Setter *> attributes;
+
+        /// Bindings created for elements holding a single value
+        std::vector<XmlBindingBase *> owned;
+
+        /// Forbidden: owns its members
+        XmlBindingBase(const XmlBindingBase &);
+        void operator = (const XmlBindingBase &);
+    };
+
+    /// Binding of the text of an element to a whole value
+    template <typename T>
+    struct XmlValueBinding : public XmlBindingBase
+    {
+        XmlValueBinding()
+        {
+            set_text(new ValueSetter);
+        }
+
+    private:
+        struct ValueSetter : public Setter
+        {
+            bool set(void * object, const char * begin, const char * end) const
+            {
+                return xml_convert(begin, end, * static_cast<T *>(object));
+            }
+        };
+    };
+
+    /// Declarative mapping of elements to a structure
+    ///
+    /// Values are converted with xml_convert(). Members and vector items are
+    /// filled from nested bindings, which must outlive this one.
+    ///
+    ///     XmlBinding<Point> point;
+    ///     point.attribute("x", & Point::x)
+    ///          .attribute("y", & Point::y);
+    ///     XmlBinding<Shape> shape;
+    ///     shape.attribute("name", & Shape::name)
+    ///          .element("color", & Shape::color)
+    ///          .elements("point", & Shape::points, point);
+    template <typename S>
+    struct XmlBinding : public XmlBindingBase
+    {
+        /// Attribute of the element
+        template <typename T>
+        XmlBinding & attribute(const std::string & name, T S::* member)
+        {
+            add_attribute(name, new MemberSetter<T>(member));
+            return * this;
+        }
+
+        /// Text of the element
+        template <typename T>
+        XmlBinding & text(T S::* member)
+        {
+            set_text(new MemberSetter<T>(member));
+            return * this;
+        }
+
+        //@{
+        /// Child element, of a single value or of a nested structure
+        template <typename T>
+        XmlBinding & element(const std::string & name, T S::* member)
+        {
+            add_child(name, new MemberChild<T>(member, own(new XmlValueBinding<T>)));
+            return * this;
+        }
+
+        template <typename T>
+        XmlBinding & element(const std::string & name, T S::* member, const XmlBinding<T> & binding)
+        {
+            add_child(name, new MemberChild<T>(member, & binding));
+            return * this;
+        }
+        //@}
+
+        //@{
+        /// Repeated child element, each one appended to a vector
+        template <typename T>
+        XmlBinding & elements(const std::string & name, std::vector<T> S::* member)
+        {
+            add_child(name, new VectorChild<T>(member, own(new XmlValueBinding<T>)));
+            return * this;
+        }
+
+        template <typename T>
+        XmlBinding & elements(const std::string & name, std::vector<T> S::* member, const XmlBinding<T> & binding)
+        {
+            add_child(name, new VectorChild<T>(member, & binding));
+            return * this;
+        }
+        //@}
+
+    private:
+        template <typename T>
+        struct MemberSetter : public Setter
+        {
+            MemberSetter(T S::* member)
+              : member(member)
+            { }
+
+            bool set(void * object, const char * begin, const char * end) const
+            {
+                return xml_convert(begin, end, static_cast<S *>(object)->* member);
+            }
+
+            T S::* member;
+        };
+
+        template <typename T>
+        struct MemberChild : public Child
+        {
+            MemberChild(T S::* member, const XmlBindingBase * binding)
+              : Child(binding), member(member)
+            { }
+
+            void * enter(void * parent) const
+            {
+                return & (static_cast<S *>(parent)->* member);
+            }
+
+            T S::* member;
+        };
+
+        template <typename T>
+        struct VectorChild : public Child
+        {
+            VectorChild(std::vector<T> S::* member, const XmlBindingBase * binding)
+              : Child(binding), member(member)
+            { }
+
+            void * enter(void * parent) const
+            {
+                std::vector<T> & v = static_cast<S *>(parent)->* member;
+                v.push_back(T());
+                return & v.back();
+            }
+
+            std::vector<T> S::* member;
+        };
+    };
+
+    /// SAX parser filling objects after an XmlBinding, without building a DOM
+    ///
+    ///     XmlBinder binder(grammar);
+    ///     Shape s;
+    ///     binder.parse(buffer, "shape", shape, s);
+    ///
+    /// Unbound elements are skipped without being parsed, unbound attributes
+    /// are ignored, and elements without text leave their value untouched.
+    /// A value which cannot be converted raises an error.
+    struct XmlBinder : public XmlParser
+    {
+        XmlBinder(XmlGrammar & grammar)
+          : XmlParser(grammar),
+            root_binding(0),
+            root_object(0)
+        { }
+
+        /// Parse the given buffer, whose root element `root` is bound to object
+        template <typename S>
+        void parse(const char * buffer, const std::string & root, const XmlBinding<S> & binding, S & object,
+                   int start_line = 1)
+        {
+            root_name = root;
+            root_binding = & binding;
+            root_object = & object;
+            frames.clear();
+            text.clear();
+            XmlParser::parse(buffer, start_line);
+        }
+
+        void on_start_element(const ell::string & name, const XmlAttributeViews & attrs);
+        void on_end_element(const ell::string & name);
+        void on_data_view(const ell::string & data);
+
+    private:
+        /// Element being filled
+        struct Frame
+        {
+            const XmlBindingBase * binding;
+            void * object;
+
+            /// Start of the element text in XmlBinder::text
+            size_t text_begin;
+        };
+
+        std::vector<Frame> frames;
+
+        std::string root_name;
+        const XmlBindingBase * root_binding;
+        void * root_object;
+
+        /// Texts of the opened elements, concatenated
+        std::string text;
+    };
+}
+
+#include <ell/impl/XmlBinding.h>
+
+#endif // INCLUDED_ELL_XMLBINDING_H
@@ -0,0 +1,70 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_XMLCONVERT_H
+#define INCLUDED_ELL_XMLCONVERT_H
+
+#include <stdint.h>
+#include <clocale>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace ell
+{
+    //@{
+    /// Conversion of the text [begin, end) to a value
+    /// Return false if the text, without its leading and trailing blanks, is
+    /// not entirely a valid value of the type.
+    ///
+    /// Integers, reals and booleans are converted without streams nor
+    /// locale: this is what attributes and data conversions use. Other types
+    /// are read by their operator >>.
+    bool xml_convert(const char * begin, const char * end, short & value);
+    bool xml_convert(const char * begin, const char * end, unsigned short & value);
+    bool xml_convert(const char * begin, const char * end, int & value);
+    bool xml_convert(const char * begin, const char * end, unsigned int & value);
+    bool xml_convert(const char * begin, const char * end, long & value);
+    bool xml_convert(const char * begin, const char * end, unsigned long & value);
+    bool xml_convert(const char * begin, const char * end, long long & value);
+    bool xml_convert(const char * begin, const char * end, unsigned long long & value);
+    bool xml_convert(const char * begin, const char * end, float & value);
+    bool xml_convert(const char * begin, const char * end, double & value);
+
+    /// Accept true, false, 1 and 0
+    bool xml_convert(const char * begin, const char * end, bool & value);
+
+    /// Copy the text as is
+    bool xml_convert(const char * begin, const char * end, std::string & value);
+
+    template <typename T>
+    bool xml_convert(const char * begin, const char * end, T & value)
+    {
+        std::istringstream i(std::string(begin, end));
+        return i >> value && (i >> std::ws).eof();
+    }
+    //@}
+
+    template <typename T>
+    bool xml_convert(const std::string & s, T & value)
+    {
+        return xml_convert(s.data(), s.data() + s.size(), value);
+    }
+}
+
+#endif // INCLUDED_ELL_XMLCONVERT_H
@@ -0,0 +1,97 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_XMLDIFF_H
+#define INCLUDED_ELL_XMLDIFF_H
+
+#include <map>
+#include <vector>
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Difference between two DOMs, see xml_diff()
+    struct XmlDifference
+    {
+        enum Kind
+        {
+            /// Data, or attributes of an element, differ: children are
+            /// compared separately
+            CHANGED,
+
+            /// new_node subtree was inserted in old_node
+            INSERTED,
+
+            /// old_node subtree was deleted from new_node
+            DELETED
+        };
+
+        Kind kind;
+        const XmlNode * old_node;
+        const XmlNode * new_node;
+    };
+
+    /// Append to `out` the differences turning old_root into new_root
+    ///
+    /// Subtrees are compared through their hashes, so that different ones are
+    /// told apart at once. Equal hashes are confirmed by XmlNode::is_equal()
+    /// before a subtree is skipped. Children of matching elements are aligned after
+    /// their common prefix and suffix, then greedily: a child whose hash
+    /// appears further in the other list is kept for later.
+    void xml_diff(const XmlNode & old_root, const XmlNode & new_root, std::vector<XmlDifference> & out);
+
+    /// Implementation of xml_diff()
+    struct XmlDiffer
+    {
+        XmlDiffer(std::vector<XmlDifference> & out)
+          : out(out)
+        { }
+
+        /// Nodes which are compared rather than deleted and inserted:
+        /// elements of the same name, or data nodes
+        static bool match(const XmlNode & a, const XmlNode & b)
+        {
+            return a.name == b.name;
+        }
+
+        /// Compare matching nodes
+        void diff(const XmlNode & a, const XmlNode & b);
+
+    private:
+        static bool same_content(const XmlNode & a, const XmlNode & b);
+
+        /// Identical subtrees: hashes may collide, so they are confirmed
+        static bool same(const XmlNode & a, const XmlNode & b)
+        {
+            return a.hash() == b.hash() && a.is_equal(b);
+        }
+
+        void diff_children(const XmlNode & a, const XmlNode & b);
+
+        void report(XmlDifference::Kind kind, const XmlNode * a, const XmlNode * b)
+        {
+            XmlDifference d = { kind, a, b };
+            out.push_back(d);
+        }
+
+        std::vector<XmlDifference> & out;
+    };
+}
+
+#include <ell/impl/XmlDiff.h>
+
+#endif // INCLUDED_ELL_XMLDIFF_H
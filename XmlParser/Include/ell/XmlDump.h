@@ -16,6 +16,8 @@
 #ifndef INCLUDED_ELL_GRAMMARXML_H
 #define INCLUDED_ELL_GRAMMARXML_H
 
+#include <map>
+
 #include <ell/Node.h>
 #include <ell/XmlNode.h>
 
@@ -0,0 +1,86 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_XMLENTITIES_H
+#define INCLUDED_ELL_XMLENTITIES_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <ell/Node.h>
+
+namespace ell
+{
+    /// Write the UTF-8 encoding of the given code point, return its size
+    /// (4 bytes at most)
+    size_t xml_encode_utf8(uint32_t code, char * out);
+
+    /// Named entities recognized by XmlParser besides the predefined ones
+    ///
+    /// Entries are kept sorted by name, so that a reference is resolved by
+    /// a single binary search without copying its name.
+    struct XmlEntityTable
+    {
+        /// Add or replace an entity, given its UTF-8 replacement text
+        void add(const std::string & name, const std::string & value);
+
+        /// Return the replacement text of the given entity, or null
+        const std::string * find(const char * name, size_t size) const;
+
+        size_t size() const { return entries.size(); }
+
+        /// The 252 entities of HTML 4
+        /// The table is built once, by the first call, and never changed
+        /// afterwards, so that concurrent parsers may share it.
+        static const XmlEntityTable & html();
+
+    private:
+        static XmlEntityTable make_html();
+
+        typedef std::pair<std::string, std::string> Entry;
+
+        struct Less
+        {
+            bool operator () (const Entry & e, const std::pair<const char *, size_t> & name) const
+            {
+                int c = memcmp(e.first.data(), name.first, std::min(e.first.size(), name.second));
+                return c < 0 || (c == 0 && e.first.size() < name.second);
+            }
+        };
+
+        std::vector<Entry> entries;
+    };
+
+    /// Grammar primitive decoding a reference: predefined, numeric
+    /// (decimal or hexadecimal, encoded in UTF-8) or named after the entity
+    /// table of the parser
+    ///
+    /// The decoded text is pushed to the current run. An unknown or
+    /// malformed reference raises an error.
+    struct XmlReference : public ConcreteNodeBase<char, XmlReference>
+    {
+        using ConcreteNodeBase<char, XmlReference>::match;
+        bool match(Parser<char> * parser, Storage<void> &) const;
+
+        std::string get_kind() const { return "reference"; }
+        std::string get_value() const { return ""; }
+    };
+}
+
+#endif // INCLUDED_ELL_XMLENTITIES_H
@@ -0,0 +1,248 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLFROZEN_H
+#define INCLUDED_ELL_XMLFROZEN_H
+
+#include <atomic>
+#include <mutex>
+
+#include <ell/XmlParser.h>
+#include <ell/XmlSerializer.h>
+
+namespace ell
+{
+    struct XmlFrozenNode;
+
+    /// Counted reference to a XmlFrozenNode, null by default
+    struct XmlFrozenRef
+    {
+        XmlFrozenRef()
+          : node(0)
+        { }
+
+        /// Add a reference to the given node
+        explicit XmlFrozenRef(const XmlFrozenNode * node);
+
+        XmlFrozenRef(const XmlFrozenRef & other);
+        ~XmlFrozenRef();
+        XmlFrozenRef & operator = (const XmlFrozenRef & other);
+
+        const XmlFrozenNode * get() const { return node; }
+        const XmlFrozenNode * operator -> () const { return node; }
+        const XmlFrozenNode & operator * () const { return * node; }
+
+        operator bool () const
+        {
+            return node != 0;
+        }
+
+    private:
+        const XmlFrozenNode * node;
+    };
+
+    /// Immutable DOM node
+    ///
+    /// Frozen nodes are only handled through const pointers, and may be shared
+    /// by several trees and read by several threads without locking.
+    /// They own their strings, so that they do not depend on the parser
+    /// nor on the name table which built the original DOM.
+    ///
+    /// Updates build a new version of the tree, sharing all the subtrees
+    /// which were not modified: only the path from the root to the
+    /// modified node is copied.
+    struct XmlFrozenNode
+    {
+        typedef std::vector<std::pair<std::string, std::string> > Attributes;
+        typedef std::vector<XmlFrozenRef> Children;
+
+        //@{
+        /// Node creation
+        static XmlFrozenRef element(const std::string & name,
+                                    const Attributes & attributes = Attributes(),
+                                    const Children & children = Children(),
+                                    int line = 0);
+        static XmlFrozenRef data_node(const std::string & data, int line = 0);
+        //@}
+
+        //@{
+        /// Kind of node enquirement
+        bool is_element() const { return ! name.empty(); }
+        bool is_data() const { return name.empty(); }
+        //@}
+
+        //@{
+        /// Attribute handling, raise error if attribute does not exist
+        const std::string & get_attrib(const ell::string & name) const;
+
+        template <typename T>
+        T get_attrib(const ell::string & name) const;
+
+        bool has_attrib(const ell::string & name) const;
+        //@}
+
+        const std::string & get_name() const
+        {
+            assert(is_element());
+            return name;
+        }
+
+        const std::string & get_data() const
+        {
+            assert(is_data());
+            return data;
+        }
+
+        //@{
+        /// Children, with random access
+        size_t child_count() const { return children.size(); }
+
+        /// Raise error if the child does not exist
+        const XmlFrozenNode * child_at(size_t i) const;
+        //@}
+
+        //@{
+        /// Copies of this node with other attributes or children,
+        /// sharing the rest
+        XmlFrozenRef with_attrib(const ell::string & name, const std::string & value) const;
+        XmlFrozenRef without_attrib(const ell::string & name) const;
+        XmlFrozenRef with_children(const Children & children) const;
+        //@}
+
+        //@{
+        /// New version of the tree rooted at this node, where the node at the
+        /// given path is replaced (removed if null), or inserted before the
+        /// given position
+        /// The path holds child indexes, from this node. Only the nodes along
+        /// the path are copied. Raise error if the path does not exist.
+        XmlFrozenRef replace(const std::vector<size_t> & path, const XmlFrozenRef & node) const;
+        XmlFrozenRef insert(const std::vector<size_t> & path, const XmlFrozenRef & node) const;
+        //@}
+
+        /// Editable copy of the subtree, with names interned in the given table
+        /// Frozen nodes may be thawed by several threads, each one with its
+        /// own table.
+        XmlNode * thaw(XmlNameTable & names) const;
+
+        /// Recursive write of resulting XML, like XmlNode::unparse()
+        void unparse(std::ostream & out, int indent = 0, int shift = 1) const;
+
+        /// Same output through the given serializer
+        void write_pretty(XmlSerializer & serializer, int indent = 0, int shift = 1) const;
+
+        friend std::ostream & operator << (std::ostream & os, const XmlFrozenNode & node)
+        {
+            node.unparse(os);
+            return os;
+        }
+
+        /// Textual representation of the node
+        std::string describe() const;
+
+        void raise_error(const std::string & msg) const;
+
+        /// Empty for data nodes
+        const std::string name;
+
+        /// Empty for elements
+        const std::string data;
+
+        const Attributes attributes;
+        const Children children;
+
+        /// Line information in the original file
+        const int line;
+
+    private:
+        XmlFrozenNode(const std::string & name, const std::string & data,
+                      const Attributes & attributes, const Children & children, int line)
+          : name(name), data(data), attributes(attributes), children(children), line(line), references(0)
+        { }
+
+        XmlFrozenRef update(const size_t * path, size_t n, const XmlFrozenRef & node, bool insert) const;
+
+        friend struct XmlFrozenRef;
+        friend struct XmlFrozenDocument;
+
+        //@{
+        /// Reference counting, the node is deleted with its last reference
+        void retain() const
+        {
+            references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release() const
+        {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+        //@}
+
+        mutable std::atomic<long> references;
+
+        /// Forbidden
+        XmlFrozenNode(const XmlFrozenNode &);
+        void operator = (const XmlFrozenNode &);
+    };
+
+    /// Immutable copy of a DOM subtree
+    XmlFrozenRef xml_freeze(const XmlNode * node);
+
+    /// Current version of a frozen tree, shared by reader threads
+    ///
+    /// Readers acquire() the current version without locking, and keep it as
+    /// long as they hold the reference, whatever the later publications.
+    /// Writers publish() new versions, usually built from the current one by
+    /// XmlFrozenNode::replace(), and are serialized by a mutex.
+    ///
+    /// The reference held on a replaced version is dropped by a later
+    /// publish() or collect(), once no reader is in the middle of acquire().
+    struct XmlFrozenDocument
+    {
+        explicit XmlFrozenDocument(const XmlFrozenRef & root = XmlFrozenRef());
+
+        /// No reader must be left
+        ~XmlFrozenDocument();
+
+        /// Current version, may be null
+        XmlFrozenRef acquire() const;
+
+        void publish(const XmlFrozenRef & root);
+
+        /// Drop the references held on replaced versions, when possible
+        void collect();
+
+    private:
+        void collect_locked();
+
+        std::atomic<const XmlFrozenNode *> current;
+
+        /// Number of readers in acquire()
+        mutable std::atomic<long> pending;
+
+        std::mutex writers;
+
+        /// Replaced versions, which may still be in use by acquire()
+        std::vector<const XmlFrozenNode *> retired;
+
+        /// Forbidden
+        XmlFrozenDocument(const XmlFrozenDocument &);
+        void operator = (const XmlFrozenDocument &);
+    };
+}
+
+#include <ell/impl/XmlFrozen.h>
+
+#endif // INCLUDED_ELL_XMLFROZEN_H
@@ -0,0 +1,314 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLNAME_H
+#define INCLUDED_ELL_XMLNAME_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define ELL_XML_NAME_LOCK 1
+#   include <pthread.h>
+#endif
+
+#include <ell/Utils.h>
+
+namespace ell
+{
+    struct XmlNameTable;
+
+    /// Interned element or attribute name
+    ///
+    /// A name is a pointer to the unique entry of its string in a XmlNameTable,
+    /// so that names of the same table compare as integers. Names of different
+    /// tables compare as strings. The empty name is the null entry.
+    struct XmlName
+    {
+        struct Entry
+        {
+            std::string str;
+
+            /// Index of the name in its table, starting at 1
+            uint32_t id;
+
+            XmlNameTable * table;
+
+            //@{
+            /// Parts of a qualified name `prefix:local`, interned in the same
+            /// table: null prefix and local part being the entry itself
+            /// for names without prefix
+            const Entry * prefix;
+            const Entry * local;
+            //@}
+        };
+
+        XmlName()
+          : entry(0)
+        { }
+
+        explicit XmlName(const Entry * entry)
+          : entry(entry)
+        { }
+
+        /// Name interned in the default table
+        explicit XmlName(const ell::string & s);
+
+        /// Intern the given string in the table of the current name,
+        /// or in the default table if it is empty
+        XmlName & operator = (const ell::string & s);
+
+        const std::string & str() const;
+        size_t size() const { return entry ? entry->str.size() : 0; }
+        bool empty() const { return entry == 0; }
+
+        /// Small integer identifying the name in its table, 0 if empty
+        uint32_t id() const { return entry ? entry->id : 0; }
+
+        /// Table owning this name, 0 if empty
+        XmlNameTable * table() const { return entry ? entry->table : 0; }
+
+        //@{
+        /// Parts of a qualified name, empty prefix if there is none
+        XmlName prefix() const { return XmlName(entry ? entry->prefix : 0); }
+        XmlName local() const { return XmlName(entry ? entry->local : 0); }
+        //@}
+
+        bool operator == (const XmlName & other) const
+        {
+            if (entry == other.entry)
+                return true;
+            if (! entry || ! other.entry || entry->table == other.entry->table)
+                return false;
+            return entry->str == other.entry->str;
+        }
+
+        bool operator != (const XmlName & other) const { return ! (* this == other); }
+
+        friend bool operator == (const XmlName & n, const ell::string & s) { return s == n.str(); }
+        friend bool operator != (const XmlName & n, const ell::string & s) { return ! (s == n.str()); }
+        friend bool operator == (const ell::string & s, const XmlName & n) { return s == n.str(); }
+        friend bool operator != (const ell::string & s, const XmlName & n) { return ! (s == n.str()); }
+
+        friend std::ostream & operator << (std::ostream & os, const XmlName & n)
+        {
+            return os << n.str();
+        }
+
+        const Entry * entry;
+    };
+
+    /// Set of interned names
+    ///
+    /// Open addressing hash table on the name strings. Entries never move, so
+    /// that names stay valid until the table is destroyed.
+    /// A table may be shared by several parsers, but not between threads,
+    /// except the default table.
+    struct XmlNameTable
+    {
+        XmlNameTable()
+          : slots(16, 0), shared(false)
+        { }
+
+        /// Return the unique name of the given string, adding it if needed
+        XmlName intern(const ell::string & s);
+
+        /// Return the name of the given string, or the empty name if absent:
+        /// no node of this table can be named like it then
+        XmlName find(const ell::string & s) const;
+
+        /// Return the name of the given id
+        XmlName operator [] (uint32_t id) const
+        {
+            Lock lock(* this);
+            return entry(id);
+        }
+
+        /// Number of distinct names
+        size_t size() const
+        {
+            Lock lock(* this);
+            return entries.size();
+        }
+
+        /// Table used for names created outside any parser
+        ///
+        /// Its calls are serialized by a mutex where pthreads are available,
+        /// otherwise it must not be used by several threads. It lives until
+        /// the end of the program, and its names are never removed.
+        /// Parsers given no table intern in it, so that their nodes may
+        /// outlive them. Programs reading unbounded sets of names should give
+        /// their own tables.
+        static XmlNameTable & default_table()
+        {
+            static XmlNameTable table(true);
+            return table;
+        }
+
+    private:
+        explicit XmlNameTable(bool shared)
+          : slots(16, 0), shared(shared)
+        { }
+
+        /// Holds the mutex of the default table, nothing for other tables
+        struct Lock
+        {
+            explicit Lock(const XmlNameTable & table)
+              : locked(table.shared)
+            {
+#               if ELL_XML_NAME_LOCK
+                if (locked)
+                    pthread_mutex_lock(& mutex());
+#               endif
+            }
+
+            ~Lock()
+            {
+#               if ELL_XML_NAME_LOCK
+                if (locked)
+                    pthread_mutex_unlock(& mutex());
+#               endif
+            }
+
+#           if ELL_XML_NAME_LOCK
+            static pthread_mutex_t & mutex()
+            {
+                // Static initialization, before any thread
+                static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+                return m;
+            }
+#           endif
+
+            bool locked;
+        };
+
+        XmlName entry(uint32_t id) const
+        {
+            return id ? XmlName(& entries[id - 1]) : XmlName();
+        }
+
+        /// intern() without locking
+        XmlName add(const ell::string & s);
+
+        static uint32_t hash(const ell::string & s);
+
+        /// Return the slot of the given string, either empty or holding it
+        size_t lookup(const ell::string & s, uint32_t h) const;
+
+        void grow();
+
+        std::deque<XmlName::Entry> entries;
+
+        /// Ids of entries, 0 for empty slots
+        /// Size is a power of two, at most half full.
+        std::vector<uint32_t> slots;
+
+        /// Only the default table is shared by threads
+        bool shared;
+
+        /// Forbidden: entries refer to their table
+        XmlNameTable(const XmlNameTable &);
+        void operator = (const XmlNameTable &);
+    };
+
+    /// Namespace prefixes in scope on an element, with their URIs
+    ///
+    /// Bindings of the ancestors are copied, so that resolving a prefix does
+    /// not walk up the tree, and a scope is shared by all the elements which
+    /// do not declare namespaces. Scopes are counted by the nodes using them.
+    struct XmlNamespaces
+    {
+        XmlNamespaces()
+          : references(0)
+        { }
+
+        /// Give the URI bound to the prefix, the empty prefix being the
+        /// default namespace, or return false if the prefix is not bound
+        bool resolve(const XmlName & prefix, XmlName & uri) const
+        {
+            for (size_t i = bindings.size(); i-- > 0; )
+            {
+                if (bindings[i].first == prefix)
+                {
+                    uri = bindings[i].second;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Bind the prefix, hiding an inherited binding
+        /// An empty URI undeclares the default namespace.
+        void bind(const XmlName & prefix, const XmlName & uri)
+        {
+            bindings.push_back(std::make_pair(prefix, uri));
+        }
+
+        /// Pairs of prefix and URI, the last binding of a prefix being in effect
+        std::vector<std::pair<XmlName, XmlName> > bindings;
+
+        //@{
+        /// Counted references, the scope is deleted with the last one
+        void retain() { ++references; }
+        void release()
+        {
+            if (--references == 0)
+                delete this;
+        }
+        //@}
+
+    private:
+        size_t references;
+
+        /// Forbidden
+        XmlNamespaces(const XmlNamespaces &);
+        void operator = (const XmlNamespaces &);
+    };
+
+    /// Translation of names into another table, interning each distinct
+    /// name once: names of a same source table are cached by id
+    struct XmlNameMap
+    {
+        /// A null table keeps names as they are
+        explicit XmlNameMap(XmlNameTable * to)
+          : to(to), from(0)
+        { }
+
+        XmlName operator () (const XmlName & name);
+
+        /// Scope with translated names, each scope being translated once
+        XmlNamespaces * operator () (XmlNamespaces * scope);
+
+    private:
+        XmlNameTable * to;
+        const XmlNameTable * from;
+        std::vector<XmlName> cache;
+        std::vector<std::pair<XmlNamespaces *, XmlNamespaces *> > scopes;
+    };
+
+    //@{
+    /// String conversions used to copy attributes between containers
+    inline void xml_assign(XmlName & to, const XmlName & from) { to = from; }
+    inline void xml_assign(XmlName & to, const ell::string & from) { to = XmlName(from); }
+    inline void xml_assign(XmlName & to, const std::string & from) { to = XmlName(ell::string(from)); }
+    inline void xml_assign(std::string & to, const XmlName & from) { to = from.str(); }
+    inline void xml_assign(ell::string & to, const XmlName & from) { to = ell::string(from.str()); }
+    //@}
+}
+
+#include <ell/impl/XmlName.h>
+
+#endif // INCLUDED_ELL_XMLNAME_H
@@ -18,18 +18,88 @@
 #ifndef INCLUDED_ELL_XMLNODE_H
 #define INCLUDED_ELL_XMLNODE_H
 
-#include <map>
 #include <cassert>
 
+#include <ell/XmlAttributes.h>
+#include <ell/XmlConvert.h>
+
 namespace ell
 {
     template <typename Token>
     struct Parser;
 
-    typedef std::map<std::string, std::string> XmlAttributesMap;
+    /// Attributes of a DOM element, in document order
+    /// (the name is historical, it is not a std::map anymore)
+    /// Four inline slots hold the attributes of most elements without
+    /// allocation.
+    typedef XmlAttributeList<XmlName, std::string, 4> XmlAttributesMap;
+
+    /// Attributes given by the SAX API, in document order
+    /// Strings point inside the parsed buffer, or inside the parser for values
+    /// containing references.
+    typedef XmlAttributeList<ell::string, ell::string, 8> XmlAttributeViews;
 
     struct XmlNode;
 
+    //@{
+    /// Hash functions of XmlNode::hash()
+    inline uint64_t xml_hash(const char * s, size_t n, uint64_t h = 14695981039346656037ULL)
+    {
+        for (size_t i = 0; i < n; ++i)
+            h = (h ^ (unsigned char) s[i]) * 1099511628211ULL;
+        return h;
+    }
+
+    inline uint64_t xml_mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return h;
+    }
+    //@}
+
+    /// Attribute to read with XmlNode::get_attribs(), built by xml_request()
+    struct XmlAttributeRequest
+    {
+        const char * name;
+        size_t size;
+        void * value;
+        bool (* convert) (const char * begin, const char * end, void * value);
+        bool required;
+
+        /// Set by XmlNode::get_attribs()
+        bool found;
+    };
+
+    template <typename T>
+    bool xml_convert_to (const char * begin, const char * end, void * value)
+    {
+        return xml_convert (begin, end, * static_cast<T *> (value));
+    }
+
+    /// Request the conversion of the given attribute to value
+    template <typename T>
+    XmlAttributeRequest xml_request (const char * name, T & value, bool required = true)
+    {
+        XmlAttributeRequest r = { name, strlen (name), & value, & xml_convert_to<T>, required, false };
+        return r;
+    }
+
+    /// Contiguous sequence of nodes
+    struct XmlNodeRange
+    {
+        XmlNodeRange(XmlNode * const * begin = 0, XmlNode * const * end = 0)
+          : begin(begin), end(end)
+        { }
+
+        size_t size() const { return end - begin; }
+        bool empty() const { return begin == end; }
+        XmlNode * operator [] (size_t i) const { return begin[i]; }
+
+        XmlNode * const * begin, * const * end;
+    };
+
     /// Iterator through XmlNode children
     /// Both normal and reverse iterator
     /// (Warning: do not use first() or last() as exit condition!)
@@ -66,13 +136,16 @@ namespace ell
         XmlNode (Parser<char> * _parser = 0, int _line = 0)
             : _next_sibling (NULL), _previous_sibling (NULL),
               _first_child (NULL), _last_child (NULL),
-              _parent (NULL), line (_line), parser (_parser)
+              _parent (NULL), line (_line), source_begin (0), source_end (0),
+              parser (_parser), hash_cache (0), child_index (0), sibling_index (0),
+              namespaces (0)
         { }
 
         /// Destruction with children nodes deletion
         virtual ~XmlNode()
         {
             delete_children();
+            set_namespaces (0);
         }
 
         //@{
@@ -89,34 +162,70 @@ namespace ell
 
         //@{
         /// Attribute handling, raise error if attribute does not exist
-        const std::string get_attrib (const std::string & name) const;
+        const std::string & get_attrib (const ell::string & name) const;
 
         template <typename T>
-        T get_attrib (const std::string & name) const;
+        T get_attrib (const ell::string & name) const;
 
         template <typename T>
-        XmlNode * get_attrib (const std::string & name, T & value);
+        XmlNode * get_attrib (const ell::string & name, T & value);
 
-        XmlNode * check_attrib (const std::string & name, const std::string & value);
-        XmlNode * check_attrib_present (const std::string & name);
+        XmlNode * check_attrib (const ell::string & name, const ell::string & value);
+        XmlNode * check_attrib_present (const ell::string & name);
         //@}
 
         /// Set output parameter 'value' only if attribute exists
         template <typename T>
-        XmlNode * get_attrib_if_present (const std::string & name, T & value);
+        XmlNode * get_attrib_if_present (const ell::string & name, T & value);
+
+        //@{
+        /// Convert several attributes in a single pass over the attribute list
+        /// Raise error if a required attribute does not exist
+        XmlNode * get_attribs (XmlAttributeRequest * requests, size_t n);
+
+        template <size_t N>
+        XmlNode * get_attribs (XmlAttributeRequest (& requests) [N])
+        {
+            return get_attribs (requests, N);
+        }
+
+        template <typename T1, typename T2>
+        XmlNode * get_attribs (const char * n1, T1 & v1, const char * n2, T2 & v2)
+        {
+            XmlAttributeRequest r[] = { xml_request (n1, v1), xml_request (n2, v2) };
+            return get_attribs (r);
+        }
+
+        template <typename T1, typename T2, typename T3>
+        XmlNode * get_attribs (const char * n1, T1 & v1, const char * n2, T2 & v2,
+                               const char * n3, T3 & v3)
+        {
+            XmlAttributeRequest r[] = { xml_request (n1, v1), xml_request (n2, v2), xml_request (n3, v3) };
+            return get_attribs (r);
+        }
+
+        template <typename T1, typename T2, typename T3, typename T4>
+        XmlNode * get_attribs (const char * n1, T1 & v1, const char * n2, T2 & v2,
+                               const char * n3, T3 & v3, const char * n4, T4 & v4)
+        {
+            XmlAttributeRequest r[] = { xml_request (n1, v1), xml_request (n2, v2), xml_request (n3, v3),
+                                        xml_request (n4, v4) };
+            return get_attribs (r);
+        }
+        //@}
 
         //@{
         /// Set attribute value
-        XmlNode * set_attrib (const std::string & name, const std::string & value);
+        XmlNode * set_attrib (const ell::string & name, const std::string & value);
 
         template <typename T>
-        XmlNode * set_attrib (const std::string & name, const T & value);
+        XmlNode * set_attrib (const ell::string & name, const T & value);
 
-        XmlNode * remove_attrib (const std::string & name);
+        XmlNode * remove_attrib (const ell::string & name);
         //@}
 
         /// Enquire about the existence of an attribute
-        bool has_attrib (const std::string & name) const;
+        bool has_attrib (const ell::string & name) const;
 
         //@{
         /// Element name handling, raise error if not an element
@@ -124,6 +233,9 @@ namespace ell
         XmlNode * get_name (std::string & name);
         XmlNode * set_name (const std::string & name);
         XmlNode * check_name (const std::string & name);
+
+        /// Integer comparison when the name comes from the same table
+        XmlNode * check_name (const XmlName & name);
         //@}
 
         //@{
@@ -165,6 +277,25 @@ namespace ell
         XmlNode * parent() const;
         //@}
 
+        //@{
+        /// Random access to children, in constant time
+        /// The array of children is built on first use, kept when children
+        /// are appended, and dropped when they are inserted or removed.
+        /// Building it modifies the node: these accessors are not thread safe
+        /// until build_index() was called on the shared subtree.
+        /// XmlIterator arithmetic uses the array if it exists, and never
+        /// builds it.
+        /// If the targetted node does not exist, raise an error
+        size_t child_count() const;
+        XmlNode * child_at (size_t i) const;
+        size_t index_in_parent() const;
+        XmlNodeRange children() const;
+        //@}
+
+        /// Build the arrays of children now, in the whole subtree if deep,
+        /// so that several threads may then use the const accessors above
+        void build_index (bool deep = true) const;
+
         XmlIterator first()
         {
             return XmlIterator (_first_child);
@@ -185,6 +316,18 @@ namespace ell
         /// Remove this node from the DOM and transfer the ownership to caller
         XmlNode * detach();
 
+        /// Deep copy of the subtree, in one pass, owned by the caller
+        /// Names are interned in the given table, or kept if null, and nodes
+        /// refer to the given parser, or to the parser of this node if null.
+        /// Known hashes are copied too.
+        XmlNode * clone (Parser<char> * parser = 0, XmlNameTable * names = 0) const;
+
+        /// Detach the subtree and make it belong to another parser, whose
+        /// names are interned in the given table, so that it can be inserted
+        /// in another document
+        /// Nodes are moved, not copied. Source positions are cleared.
+        XmlNode * transfer (Parser<char> * parser, XmlNameTable & names);
+
         /// Delete all children of this node
         void delete_children();
 
@@ -192,7 +335,38 @@ namespace ell
         XmlAttributesMap attributes;
 
         /// Name of the node if this is an element
-        std::string name;
+        /// Interned in the table of the parser which created the node,
+        /// or in the default one.
+        XmlName name;
+
+        /// Namespace URI of the element, interned in the table of its name
+        /// Set by XmlDomParser in namespace mode, empty if none.
+        XmlName ns;
+
+        //@{
+        /// Namespace handling, in namespace mode
+        /// Names are compared as integers when they come from the same table.
+        XmlName local_name() const { return name.local(); }
+        bool is_named (const XmlName & uri, const XmlName & local) const;
+
+        /// Namespace URI of the given attribute name, empty if none
+        /// Raise error if its prefix is not bound.
+        XmlName attrib_namespace (const XmlName & attr_name) const;
+
+        /// Raise error if the attribute does not exist
+        const std::string & get_attrib_ns (const XmlName & uri, const XmlName & local) const;
+        bool has_attrib_ns (const XmlName & uri, const XmlName & local) const;
+
+        /// Prefixes in scope, null outside namespace mode
+        XmlNamespaces * get_namespaces() const { return namespaces; }
+        void set_namespaces (XmlNamespaces * scope);
+        //@}
+
+        /// Table where new names of this node are interned
+        XmlNameTable & name_table() const
+        {
+            return name.table() ? * name.table() : XmlNameTable::default_table();
+        }
 
         /// Text of the node if this is a data node
         std::string data;
@@ -203,11 +377,19 @@ namespace ell
         /// Nodes recursive comparison
         bool is_equal (const XmlNode & other) const;
 
+        //@{
+        /// Hash of the content of the subtree: names, data and attributes,
+        /// whatever the order of the attributes
+        /// It is computed once bottom-up, then cached until the subtree is
+        /// modified through the methods of this class. After a direct change
+        /// of the public members, call invalidate_hash().
+        uint64_t hash() const;
+        void invalidate_hash();
+        //@}
+
         /// Tell the parser to raise a syntax error on the given node
-        void raise_error (const std::string & msg) const
-        {
-            parser->raise_error (msg, line);
-        }
+        /// Nodes without parser raise a std::runtime_error themselves.
+        void raise_error (const std::string & msg) const;
 
         //@{
         /// Links to sibbling, children and parent nodes
@@ -221,9 +403,43 @@ namespace ell
         /// Line information in the original file
         int line;
 
+        //@{
+        /// Byte range of an element in the buffer parsed by XmlDomParser,
+        /// from its `<` to the end of its end tag
+        /// Empty for data nodes.
+        size_t source_begin, source_end;
+        //@}
+
         /// Reference to the parser which created this DOM
         Parser<char> * parser;
 
+    private:
+        /// 0 if not computed yet
+        /// When set, the hashes of all descendants are set too.
+        mutable uint64_t hash_cache;
+
+        XmlNode * clone (Parser<char> * parser, XmlNameMap & names) const;
+        void rebind (Parser<char> * parser, XmlNameMap & names);
+
+        friend struct XmlIterator;
+
+        void build_child_index() const;
+        void drop_child_index();
+
+        /// Children array, null if not built
+        mutable std::vector<XmlNode *> * child_index;
+
+        /// Index in the children array of the parent, if built
+        mutable size_t sibling_index;
+
+        /// Counted reference
+        XmlNamespaces * namespaces;
+
+        /// Attribute matching the namespace and local name, or end
+        XmlAttributesMap::const_iterator find_attrib_ns (const XmlName & uri, const XmlName & local) const;
+
+    public:
+
         /// Forbidden
         XmlNode (const XmlNode &);
     };
@@ -275,22 +491,20 @@ namespace ell
     };
 
     template <typename T>
-    inline void _get_attrib (const XmlNode & n, const std::string & name, T & value)
+    inline void _get_attrib (const XmlNode & n, const ell::string & name, T & value)
     {
-        std::istringstream i (n.get_attrib (name));
-
-        if (! (i >> value))
+        if (! xml_convert (n.get_attrib (name), value))
             n.raise_error ("Wrong type for attribute " + name);
     }
 
     template <>
-    inline void _get_attrib<std::string> (const XmlNode & n, const std::string & name, std::string & value)
+    inline void _get_attrib<std::string> (const XmlNode & n, const ell::string & name, std::string & value)
     {
         value = n.get_attrib (name);
     }
 
     template <typename T>
-    T XmlNode::get_attrib (const std::string & name) const
+    T XmlNode::get_attrib (const ell::string & name) const
     {
         T value;
         _get_attrib<T> (* this, name, value);
@@ -298,31 +512,26 @@ namespace ell
     }
 
     template <typename T>
-    XmlNode * XmlNode::get_attrib (const std::string & name, T & value)
+    XmlNode * XmlNode::get_attrib (const ell::string & name, T & value)
     {
         _get_attrib<T> (* this, name, value);
         return this;
     }
 
     template <typename T>
-    XmlNode * XmlNode::get_attrib_if_present (const std::string & name, T & value)
+    XmlNode * XmlNode::get_attrib_if_present (const ell::string & name, T & value)
     {
         assert (is_element());
         XmlAttributesMap::const_iterator i = attributes.find (name);
 
-        if (i != attributes.end())
-        {
-            std::istringstream is (i->second);
-
-            if (! (i >> value))
-                raise_error ("Wrong type for attribute " + name);
-        }
+        if (i != attributes.end() && ! xml_convert (i->second, value))
+            raise_error ("Wrong type for attribute " + name);
 
         return this;
     }
 
     template <typename T>
-    inline void _set_attrib (XmlNode & n, const std::string & name, const T & value)
+    inline void _set_attrib (XmlNode & n, const ell::string & name, const T & value)
     {
         std::ostringstream oss;
         oss << value;
@@ -330,13 +539,13 @@ namespace ell
     }
 
     template <>
-    inline void _set_attrib<std::string> (XmlNode & n, const std::string & name, const std::string & value)
+    inline void _set_attrib<std::string> (XmlNode & n, const ell::string & name, const std::string & value)
     {
         n.set_attrib (name, value);
     }
 
     template <typename T>
-    XmlNode * XmlNode::set_attrib (const std::string & name, const T & value)
+    XmlNode * XmlNode::set_attrib (const ell::string & name, const T & value)
     {
         _set_attrib<T> (* this, name, value);
         return this;
@@ -345,9 +554,7 @@ namespace ell
     template <typename T>
     inline void _get_data (XmlNode & n, T & value)
     {
-        std::istringstream i (n.get_data());
-
-        if (! (i >> value))
+        if (! xml_convert (n.get_data(), value))
             n.raise_error ("Wrong type for data " + n.get_data());
     }
 
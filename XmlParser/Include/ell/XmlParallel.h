@@ -0,0 +1,131 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLPARALLEL_H
+#define INCLUDED_ELL_XMLPARALLEL_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Slice of the walk of a DOM, run by one task of XmlParallelVisitor
+    struct XmlVisitTask
+    {
+        enum Kind
+        {
+            /// Walk of `count` consecutive siblings, with their subtrees
+            SUBTREES,
+
+            //@{
+            /// Single event on a node whose subtree is cut in several tasks
+            ENTER,
+            LEAVE
+            //@}
+        };
+
+        XmlVisitTask(Kind kind, const XmlNode * first, size_t count = 1)
+          : kind(kind), first(first), count(count)
+        { }
+
+        Kind kind;
+        const XmlNode * first;
+        size_t count;
+    };
+
+    /// Cut the walk of a DOM into tasks of about `threshold` nodes
+    /// Subtrees bigger than the threshold are cut further, and consecutive
+    /// smaller siblings are packed together. Tasks are appended in the order
+    /// of the sequential walk.
+    void xml_partition(const XmlNode * root, size_t threshold, std::vector<XmlVisitTask> & tasks);
+
+    /// XML DOM visitor spreading subtrees on threads (this requires C++11)
+    ///
+    /// The tree is cut with xml_partition(), and tasks are scheduled on a pool
+    /// of workers: each one runs tasks from its own queue and, once idle,
+    /// steals tasks from the other queues.
+    ///
+    /// Each task fills its own accumulator, so that the spreading of tasks on
+    /// workers does not change the result: accumulators are reduced by the
+    /// calling thread in the order of tasks, which is the order of the
+    /// sequential walk. The result is the one of the sequential walk when
+    /// reducing a task into the previous ones gives the accumulator of both
+    /// walks one after the other, like appending to a list: the reduction
+    /// need not be commutative.
+    ///
+    /// Nodes are given as const pointers and must not be modified while
+    /// processing. hash() and the child index are lazily built caches,
+    /// not thread safe: call hash() and XmlNode::build_index() on the root
+    /// before processing, or do not use them in callbacks.
+    ///
+    /// If a callback throws, remaining tasks are cancelled and the first
+    /// exception is rethrown by process().
+    template <typename Accumulator>
+    struct XmlParallelVisitor
+    {
+        /// Zero workers means one per hardware thread
+        explicit XmlParallelVisitor(size_t workers = 0, size_t threshold = 4096)
+          : workers(workers), threshold(threshold)
+        { }
+
+        virtual ~XmlParallelVisitor() { }
+
+        /// Visit the subtree, and return the reduction of task accumulators
+        Accumulator process(const XmlNode * root);
+
+        virtual void enterNode(const XmlNode *, Accumulator &) { }
+        virtual void leaveNode(const XmlNode *, Accumulator &) { }
+
+        /// Merge the accumulator of a task into the one of previous tasks
+        virtual void reduce(Accumulator & into, const Accumulator & from) = 0;
+
+        size_t workers, threshold;
+
+    private:
+        /// Task queue of a worker
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void visit(const XmlNode * node, Accumulator & acc);
+        void run(const XmlVisitTask & task, Accumulator & acc);
+
+        /// Next task for the given worker, or false if there is none left
+        bool next_task(size_t worker, size_t & task);
+
+        void work(size_t worker);
+
+        //@{
+        /// State of the current process() call
+        std::vector<XmlVisitTask> tasks;
+        std::vector<Accumulator> results;
+        std::deque<Queue> queues;
+        std::atomic<bool> cancelled;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        //@}
+    };
+}
+
+#include <ell/impl/XmlParallel.h>
+
+#endif // INCLUDED_ELL_XMLPARALLEL_H
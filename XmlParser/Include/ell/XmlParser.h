@@ -16,12 +16,16 @@
 #ifndef INCLUDED_ELL_XMLPARSER_H
 #define INCLUDED_ELL_XMLPARSER_H
 
+#include <algorithm>
+#include <cstring>
 #include <stack>
 
 #include <ell/Grammar.h>
 #include <ell/Parser.h>
 
 #include <ell/XmlNode.h>
+#include <ell/XmlEntities.h>
+#include <ell/XmlScan.h>
 
 namespace ell
 {
@@ -45,8 +49,14 @@ namespace ell
         /// Protect the given string using standard XML entities
         static std::string protect(const std::string & cdata);
 
+        //@{
+        /// Primitives consuming runs of characters, see XmlJump
+        XmlJump jump(const char * stops) const { return XmlJump(stops); }
+        XmlJump jump_to(const char * terminator) const { return XmlJump("", terminator); }
+        //@}
+
         /// Grammar rules
-        Rule<char> document, element, attribute, reference, comment, pi, cdata, data, ident;
+        Rule<char> document, item, element, attribute, reference, comment, pi, cdata, data, ident;
 
     private:
         XmlGrammar(const XmlGrammar &);
@@ -58,39 +68,177 @@ namespace ell
         typedef Parser<char> base_type;
 
         XmlParser(XmlGrammar & grammar)
-          : Parser<char>(& grammar.document, & grammar.blank)
+          : Parser<char>(& grammar.document, & grammar.blank),
+            attributes_given(false),
+            starting_single(false),
+            skipped(false),
+            run((const char *) 0, (size_t) 0),
+            run_copied(false),
+            insitu_buffer(0),
+            insitu_begin(0),
+            insitu_write(0),
+            reference_position(0),
+            use_structural_index(false),
+            entities(0),
+            source(0)
         { 
             flags.look_ahead = false;
         }
 
+        using base_type::parse;
+
+        void parse(const char * buffer, int start_line = 1)
+        {
+            SafeModify<const char *> m(structural_index.base, 0);
+            source = buffer;
+            clear_elements();
+            if (use_structural_index)
+                structural_index.build(buffer, strlen(buffer));
+            base_type::parse(buffer, start_line);
+        }
+
+        /// Two-stage parsing: index structural characters of the whole buffer
+        /// first, then parse by jumping between them
+        /// This pays off on documents with long texts and attribute values.
+        void set_structural_index(bool enable) { use_structural_index = enable; }
+
+        /// Named entities recognized besides the predefined ones, none by default
+        /// e.g. `set_entities(& XmlEntityTable::html())`
+        /// The table must outlive the parser. Replacement texts longer than
+        /// their reference are rejected when parsing in situ.
+        void set_entities(const XmlEntityTable * table) { entities = table; }
+        const XmlEntityTable * get_entities() const { return entities; }
+
+        /// In-situ parsing, like the one of rapidxml: entities are decoded in place
+        /// by compacting the given buffer (decoded text is never longer than its
+        /// source), so that no string is copied at all.
+        /// Given strings point inside the buffer, so it must outlive them.
+        void parse_insitu(char * buffer, int start_line = 1)
+        {
+            SafeModify<char *> m(insitu_buffer, buffer);
+            insitu_write = 0;
+            parse(buffer, start_line);
+        }
+
+        bool is_insitu() const { return insitu_buffer != 0; }
+
         //@{
         /// SAX API
-        virtual void on_start_element(const ell::string & name, const XmlAttributesMap & attrs) = 0;
+        /// Given strings point inside the parsed buffer, or inside the parser for
+        /// runs containing references: these ones are only valid until the next
+        /// text, or the attributes of the next element, are parsed.
+        virtual void on_start_element(const ell::string & name, const XmlAttributeViews & attrs) = 0;
         virtual void on_end_element(const ell::string & name) = 0;
-        virtual void on_data(std::string & data) = 0;
+        virtual void on_data_view(const ell::string & data);
         //@}
 
+        /// Copying text callback, called by the default on_data_view()
+        /// The given string may be swapped out.
+        virtual void on_data(std::string &) { }
+
+    protected:
+        /// Skip the content and the end of the element just started,
+        /// without callbacks nor checks
+        /// Names of nested elements are not checked against their ends.
+        void skip_element();
+
+        /// Called from on_start_element(): skip the content of this element,
+        /// so that on_end_element() is not called for it
+        void skip_current_element()
+        {
+            if (! starting_single)
+                skip_element();
+            skipped = true;
+        }
+
+        /// Number of elements opened
+        size_t depth() const { return elements.size(); }
+
+        /// Offset of p in the buffer given to parse()
+        size_t source_offset(const char * p) const { return p - source; }
+
+        /// Forget elements opened by a previous parsing
+        void clear_elements()
+        {
+            while (! elements.empty())
+                elements.pop();
+        }
+
+        void on_end_of_file()
+        {
+            if (! elements.empty())
+                raise_error("Unclosed element: `" + elements.top() + "`", line_number);
+        }
+
     private:
         friend struct XmlGrammar;
+        friend struct XmlJump;
+        friend struct XmlText;
+        friend struct XmlReference;
+
+        /// See xml_find()
+        const char * find(const char * p, const char * stops, int & lines) const
+        {
+            if (structural_index.base && structural_index.contains(p))
+                return structural_index.find(p, stops, lines);
+            return xml_find(p, stops, lines);
+        }
+
+        /// Advance past the given string, raising an error if it is not found
+        void skip_past(const char * s);
 
         void on_data_()
         {
-            on_data(cdata);
-            cdata.clear();
+            on_data_view(end_run());
+        }
+
+        void start_element()
+        {
+            reset_attributes();
+
+            // Values decoded by the parser are now at their final place
+            for (std::vector<std::pair<size_t, size_t> >::const_iterator i = decoded_attributes.begin();
+                 i != decoded_attributes.end();
+                 ++i)
+            {
+                (attributes.begin() + i->first)->second.position = attribute_data.c_str() + i->second;
+            }
+
+            on_start_element(element_name, attributes);
+            attributes_given = true;
+        }
+
+        /// Attributes given to on_start_element() are kept until the next
+        /// element, so that they stay valid for pull parsing
+        void reset_attributes()
+        {
+            if (attributes_given)
+            {
+                attributes.clear();
+                attribute_data.clear();
+                decoded_attributes.clear();
+                attributes_given = false;
+            }
         }
 
         void on_start_double()
         { 
             elements.push(element_name);
-            on_start_element(element_name, attributes);
-            attributes.clear();
+            start_element();
+            skipped = false;
         }
 
         void on_single()
         {
-            on_start_element(element_name, attributes);
-            attributes.clear();
-            on_end_element(element_name);
+            {
+                SafeModify<> m(starting_single, true);
+                start_element();
+            }
+
+            if (skipped)
+                skipped = false;
+            else
+                on_end_element(element_name);
         }
 
         void on_end_double(const ell::string & name)
@@ -107,74 +255,399 @@ namespace ell
 
         void on_attribute()
         {
-            attributes[std::string(attribute_name.position, attribute_name.size())].swap(cdata);
-            cdata.clear();
+            reset_attributes();
+            bool copied = run_copied;
+            ell::string value = end_run();
+
+            if (copied)
+            {
+                // Keep the decoded value until the end of the element
+                decoded_attributes.push_back(std::make_pair(attributes.size(), attribute_data.size()));
+                attribute_data.append(value.position, value.size());
+            }
+
+            attributes.push_back(attribute_name, value);
         }
 
-        void on_end_of_file()
+        /// Append the decoded text of the reference [begin, end)
+        void push_reference(const char * begin, const char * end, const char * text, size_t n)
         {
-            if (! elements.empty())
-                raise_error("Unclosed element: `" + elements.top() + "`", line_number);
+            if (is_insitu() && n > (size_t) (end - begin))
+                raise_error("Reference `" + std::string(begin, end) + "` too long to be decoded in situ",
+                            line_number);
+            reference_position = begin;
+            for (size_t i = 0; i < n; ++i)
+                push_char(text[i]);
+        }
+
+        void push_char(char c)
+        {
+            if (is_insitu())
+            {
+                // A reference starts the run: decoding begins at its `&`
+                if (! insitu_write)
+                    insitu_write = insitu_begin = const_cast<char *>(reference_position);
+                * insitu_write++ = c;
+            }
+            else
+            {
+                copy_run();
+                cdata += c;
+            }
+        }
+
+        void push_string(const ell::string & s)
+        {
+            if (is_insitu())
+            {
+                // The buffer given to parse_insitu() is mutable
+                char * source = const_cast<char *>(s.position);
+                if (! insitu_write)
+                    insitu_write = insitu_begin = source;
+                else if (insitu_write != source)
+                    memmove(insitu_write, source, s.size());
+                insitu_write += s.size();
+            }
+            else if (! run_copied && ! run.position)
+            {
+                run = s;
+            }
+            else
+            {
+                copy_run();
+                cdata.append(s.position, s.size());
+            }
+        }
+
+        /// A run made of several pieces needs to be decoded in cdata
+        void copy_run()
+        {
+            if (! run_copied)
+            {
+                cdata.clear();
+                if (run.position)
+                    cdata.append(run.position, run.size());
+                run_copied = true;
+            }
         }
 
-        void push_amp() { cdata += '&'; }
-        void push_apos() { cdata += '\''; }
-        void push_quot() { cdata += '\"'; }
-        void push_lt() { cdata += '<'; }
-        void push_gt() { cdata += '>'; }
+        /// Return the text of the current run and start a new one
+        /// The returned string is a slice of the parsed buffer if possible,
+        /// else it points to cdata.
+        ell::string end_run()
+        {
+            ell::string r(position, (size_t) 0);
+
+            if (is_insitu())
+            {
+                if (insitu_write)
+                    r = ell::string(insitu_begin, insitu_write);
+                insitu_write = 0;
+            }
+            else
+            {
+                if (run_copied)
+                    r = ell::string(cdata);
+                else if (run.position)
+                    r = run;
+                run = ell::string((const char *) 0, (size_t) 0);
+                run_copied = false;
+            }
 
-        void push_string(const ell::string & s) { cdata.append(s.position, s.size()); }
+            return r;
+        }
 
-        XmlAttributesMap attributes;
+        XmlAttributeViews attributes;
         std::stack<ell::string> elements;
         ell::string element_name;
         ell::string attribute_name;
         std::string cdata;
+
+        //@{
+        /// Values of the current element attributes which had to be decoded,
+        /// and their (attribute index, offset) in this storage
+        std::string attribute_data;
+        std::vector<std::pair<size_t, size_t> > decoded_attributes;
+        //@}
+
+        /// Set once attributes were given to on_start_element()
+        bool attributes_given;
+
+        //@{
+        /// State of skip_current_element()
+        bool starting_single;
+        bool skipped;
+        //@}
+
+        //@{
+        /// Current run of text, while it is a slice of the parsed buffer
+        ell::string run;
+        bool run_copied;
+        //@}
+
+        //@{
+        /// In-situ parsing state: buffer, decoded run and write cursor
+        char * insitu_buffer;
+        char * insitu_begin;
+        char * insitu_write;
+        const char * reference_position;
+        //@}
+
+        bool use_structural_index;
+        XmlStructuralIndex structural_index;
+
+        const XmlEntityTable * entities;
+
+        /// Buffer being parsed
+        const char * source;
     };
 
     struct XmlDomParser : public XmlParser
     {
-        XmlDomParser(XmlGrammar & grammar)
+        /// Names are interned in the given table, shared with other parsers,
+        /// or else in the default table
+        /// Nodes must not outlive the given table, while names of the default
+        /// table live until the end of the program.
+        XmlDomParser(XmlGrammar & grammar, XmlNameTable * names = 0)
           : XmlParser(grammar),
+            local_names(),
+            default_names(& XmlNameTable::default_table()),
+            names(names ? * names : XmlNameTable::default_table()),
             document(),
-            current(& document)
+            current(& document),
+            element_depth(0),
+            record_depth(0),
+            match_depth(0),
+            use_namespaces(false),
+            xml_grammar(grammar)
         {
             document.parser = this;
         }
 
+        /// Only build the subtrees matching the given absolute path, like
+        /// `/feed/entry/price`, where `*` matches any element
+        /// Ancestors of matching elements are built without their text, other
+        /// elements are skipped without being parsed.
+        void add_filter(const std::string & path)
+        {
+            if (path.empty() || path[0] != '/')
+                throw std::runtime_error("Filter must be an absolute path: " + path);
+
+            std::vector<std::string> steps;
+            for (size_t b = 1, e; b <= path.size(); b = e + 1)
+            {
+                e = std::min(path.find('/', b), path.size());
+                if (e == b)
+                    throw std::runtime_error("Empty step in filter: " + path);
+                steps.push_back(path.substr(b, e - b));
+            }
+            filters.push_back(steps);
+        }
+
+        void clear_filters() { filters.clear(); }
+
+        //@{
+        /// Record mode: each complete element with the given name, or at the
+        /// given depth (the root element being at depth 1), is detached from
+        /// the DOM and given to on_record(), so that memory is bounded by the
+        /// biggest record
+        void set_record(const std::string & name) { record_name = intern(name); }
+        void set_record_depth(int depth) { record_depth = depth; }
+        //@}
+
+        /// Namespace mode: prefixes are resolved while parsing, setting the
+        /// namespace URI of elements and the prefixes in scope on each node
+        /// Raise an error on undeclared prefixes.
+        void set_namespace_mode(bool enable) { use_namespaces = enable; }
+
+        /// Return true to take the ownership of the record, else it is deleted
+        /// A kept record is unbound from this parser, and may outlive it: its
+        /// names are in the default table, or in the table given to the
+        /// constructor, which must outlive the record.
+        virtual bool on_record(XmlNode *) { return false; }
+
         /// Document node is not the XML root element
         /// It could also contain DOCTYPE, etc.
         XmlNode * get_root() { return document.first_child(); }
 
+        /// Update the DOM after the bytes [begin, end) of the buffer it was
+        /// parsed from were replaced
+        ///
+        /// Only the smallest element strictly enclosing the edit is parsed
+        /// again, with its own tags, and spliced in place. Positions and
+        /// lines of the following nodes are shifted. The whole document is
+        /// parsed again if no element encloses the edit, that is if it
+        /// reaches the first or last byte of the root element, or if the new
+        /// text of the enclosing element is not a single element.
+        /// Return the new element. On a syntax error, the DOM is unchanged.
+        /// Filters and records are not supported.
+        XmlNode * reparse(const char * old_buffer, size_t begin, size_t end, const std::string & replacement);
+
         void write(std::ostream & os)
         {
             os << "<?xml version=\"1.0\"?>\n" << * get_root();
         }
 
-        XmlNode document;
-        XmlNode * current;
+    private:
+        //@{
+        /// Unlocked front of the default table: each name is interned once
+        /// in the default table, then found in the local one
+        XmlNameTable local_names;
+        XmlNameMap default_names;
+        //@}
 
-        void on_data(std::string & data)
+        XmlName intern(const ell::string & s)
         {
-            ELL_DUMP("Enqueue data `" + data + '`');
-            current->enqueue_child(new XmlNode(this, line_number))->data.swap(data);
+            if (& names != & XmlNameTable::default_table())
+                return names.intern(s);
+            return default_names(local_names.intern(s));
         }
 
-        void on_start_element(const ell::string & name, const XmlAttributesMap & attrs)
+    public:
+        /// Table of element and attribute names of the document
+        XmlNameTable & names;
+
+        XmlNode document;
+        XmlNode * current;
+
+        void on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
         {
+            if (match_depth)
+                ++match_depth;
+            else if (! filters.empty() && ! filter(name))
+            {
+                ELL_DUMP("Skip element `" + name + '`');
+                skip_current_element();
+                return;
+            }
+
             ELL_DUMP("Enqueue element `" + name + '`');
+            ++element_depth;
             current = current->enqueue_child(new XmlNode(this, line_number));
-            current->name.assign(name.position, name.size());
-            current->attributes = attrs;
+            current->source_begin = source_offset(name.position - 1);
+            current->name = intern(name);
+            current->attributes.reserve(attrs.size());
+            for (XmlAttributeViews::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+                current->attributes.push_back(intern(i->first), i->second.str());
+            if (use_namespaces)
+                resolve_namespaces(current);
         }
 
         void on_end_element(const ell::string &)
         {
+            if (match_depth)
+                --match_depth;
+            else if (! filters.empty())
+            {
+                alive.resize(alive_begin.back());
+                alive_begin.pop_back();
+            }
+
+            // After a single tag, or else inside the end tag, which may be
+            // truncated: the parse then fails on the missing '>'
+            const char * e = position;
+            if (position[-1] != '>' && (e = strchr(position, '>')))
+                ++e;
+            current->source_end = source_offset(e ? e : position);
+
+            XmlNode * node = current;
             current = current->parent();
+
+            if (element_depth-- == record_depth || (! record_name.empty() && node->name == record_name))
+            {
+                node->detach();
+                if (on_record(node))
+                    disown(node);
+                else
+                    delete node;
+            }
+        }
+
+        void on_data_view(const ell::string & data)
+        {
+            if (! filters.empty() && ! match_depth)
+                return;
+
+            ELL_DUMP("Enqueue data `" + data + '`');
+            current->enqueue_child(new XmlNode(this, line_number))->data.assign(data.position, data.size());
+        }
+
+    private:
+        /// Bind the namespaces declared by the element, and resolve its name
+        void resolve_namespaces(XmlNode * element);
+
+        /// Move the nodes of the given document in this DOM, at the given offset
+        void adopt(XmlNode * node, size_t offset);
+
+        /// Unbind the nodes of a kept record from this parser
+        void disown(XmlNode * node);
+
+        /// Shift the nodes after the given one in document order
+        void shift_following(XmlNode * node, long bytes, int lines);
+
+        /// Return true if the element must be built, and update filtering state
+        bool filter(const ell::string & name)
+        {
+            size_t depth = alive_begin.size();
+            size_t end = alive.size();
+            size_t count = depth ? end - alive_begin.back() : filters.size();
+            bool prefix = false;
+
+            // Filters matching ancestors, and this element
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t f = depth ? alive[end - count + i] : i;
+                const std::string & step = filters[f][depth];
+                if (step == "*" || name == step)
+                {
+                    if (filters[f].size() == depth + 1)
+                    {
+                        alive.resize(end);
+                        match_depth = 1;
+                        return true;
+                    }
+                    alive.push_back(f);
+                    prefix = true;
+                }
+            }
+
+            if (prefix)
+                alive_begin.push_back(end);
+            else
+                alive.resize(end);
+            return prefix;
         }
+
+        std::vector<std::vector<std::string> > filters;
+
+        //@{
+        /// Filters matching the opened elements: those matching the n first
+        /// ones are alive[alive_begin[n - 1]] and after
+        std::vector<size_t> alive;
+        std::vector<size_t> alive_begin;
+        //@}
+
+        //@{
+        /// Record mode
+        int element_depth;
+        int record_depth;
+        XmlName record_name;
+        //@}
+
+        /// Depth inside a matching subtree, 0 outside
+        int match_depth;
+
+        bool use_namespaces;
+
+        XmlGrammar & xml_grammar;
     };
 }
 
+#include <ell/XmlSerializer.h>
+
+#include <ell/impl/XmlConvert.h>
+#include <ell/impl/XmlEntities.h>
+#include <ell/impl/XmlScan.h>
 #include <ell/impl/XmlParser.h>
 #include <ell/impl/XmlNode.h>
 
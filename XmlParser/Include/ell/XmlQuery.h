@@ -0,0 +1,163 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLQUERY_H
+#define INCLUDED_ELL_XMLQUERY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Compiled query, in a subset of XPath:
+    ///   - child (`/`) and descendant (`//`) axes, absolute or relative paths
+    ///   - name tests, `*` for any element and `text()` for data nodes
+    ///   - predicates `[n]`, `[last()]`, `[@name]` and `[@name='value']`
+    ///
+    /// Example: `//book[@lang="en"]/title[1]`
+    struct XmlQuery
+    {
+        struct Predicate
+        {
+            enum Kind { POSITION, LAST, HAS_ATTRIBUTE, ATTRIBUTE_EQUALS };
+
+            Kind kind;
+            unsigned long position;
+            std::string name, value;
+        };
+
+        struct Step
+        {
+            enum Test { ELEMENT, ANY_ELEMENT, TEXT };
+
+            bool descendant;
+            Test test;
+            std::string name;
+            std::vector<Predicate> predicates;
+        };
+
+        /// Raise a std::runtime_error if the path is not valid
+        explicit XmlQuery(const std::string & path);
+
+        bool absolute;
+        std::vector<Step> steps;
+    };
+
+    /// Secondary indexes on a DOM, and query evaluation using them
+    ///
+    /// Indexes are built lazily, on first use: nodes in document order with
+    /// child arrays, nodes by element name, and elements by id attribute.
+    /// Once built, they are read-only: a XmlIndex can be shared by threads
+    /// reading the DOM (this requires C++11).
+    ///
+    /// The DOM must not be modified while the index is used: call reset()
+    /// after modifications.
+    struct XmlIndex
+    {
+        explicit XmlIndex(XmlNode * root, const std::string & id_attribute = "id")
+          : root(root),
+            id_attribute(id_attribute),
+            has_structure(false),
+            has_names(false),
+            has_ids(false)
+        { }
+
+        /// Children of the given node, with random access
+        XmlNodeRange children(const XmlNode * node) const;
+
+        /// Elements with the given name, in document order
+        XmlNodeRange elements_named(const ell::string & name) const;
+
+        /// Element whose id attribute has the given value, or null
+        XmlNode * element_by_id(const ell::string & id) const;
+
+        //@{
+        /// Nodes selected by the query in document order
+        /// Relative queries start at the given context, or at the root.
+        std::vector<XmlNode *> select(const XmlQuery & query, XmlNode * context = 0) const;
+
+        std::vector<XmlNode *> select(const std::string & path, XmlNode * context = 0) const
+        {
+            return select(XmlQuery(path), context);
+        }
+        //@}
+
+        /// First selected node, or null
+        XmlNode * select_first(const std::string & path, XmlNode * context = 0) const;
+
+        /// Drop indexes, not thread safe
+        void reset();
+
+        XmlNode * const root;
+        const std::string id_attribute;
+
+    private:
+        static const uint32_t npos = 0xFFFFFFFF;
+
+        /// Nodes in document order, identified by their ordinal
+        /// The subtree of node i is [i, subtree_end[i]).
+        struct Structure
+        {
+            std::vector<XmlNode *> nodes;
+            std::vector<uint32_t> parents, subtree_end;
+            std::unordered_map<const XmlNode *, uint32_t> ordinals;
+
+            /// Children of node i are [child_nodes[child_begin[i]], child_nodes[child_begin[i + 1]])
+            std::vector<uint32_t> child_begin;
+            std::vector<XmlNode *> child_nodes;
+        };
+
+        /// Ordinals of nodes with the same name
+        typedef std::unordered_map<std::string, std::vector<uint32_t> > NameIndex;
+
+        /// Name index with node pointers, for elements_named()
+        typedef std::unordered_map<std::string, std::vector<XmlNode *> > NodeNameIndex;
+
+        typedef std::unordered_map<std::string, XmlNode *> IdIndex;
+
+        const Structure & structure() const;
+        const NameIndex & names() const;
+        const IdIndex & ids() const;
+
+        uint32_t ordinal(const XmlNode * node) const;
+
+        bool match_test(const XmlQuery::Step & step, const XmlNode * node) const;
+
+        /// Append candidates of the step from the given context node
+        void candidates(const XmlQuery::Step & step, uint32_t context, std::vector<uint32_t> & out) const;
+
+        /// Filter nodes having the same parent by the step predicates
+        void filter(const XmlQuery::Step & step, std::vector<uint32_t> & group) const;
+
+        mutable std::mutex mutex;
+        mutable std::atomic<bool> has_structure, has_names, has_ids;
+        mutable Structure structure_;
+        mutable NameIndex names_;
+        mutable NodeNameIndex node_names_;
+        mutable IdIndex ids_;
+
+        /// Forbidden
+        XmlIndex(const XmlIndex &);
+        void operator = (const XmlIndex &);
+    };
+}
+
+#include <ell/impl/XmlQuery.h>
+
+#endif // INCLUDED_ELL_XMLQUERY_H
@@ -0,0 +1,153 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLREADER_H
+#define INCLUDED_ELL_XMLREADER_H
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Pull parser: the caller asks for events one at a time
+    ///
+    /// Each call to next() parses one item of the document: comments and
+    /// processing instructions are skipped, and `<a/>` gives two events.
+    /// Given strings are valid until the next call to next().
+    ///
+    ///     XmlReader r(grammar);
+    ///     r.open(buffer);
+    ///     while (r.next() != XmlReader::END_DOCUMENT)
+    ///         ...
+    struct XmlReader : public XmlParser
+    {
+        enum Event { NONE, START_ELEMENT, END_ELEMENT, TEXT, END_DOCUMENT };
+
+        XmlReader(XmlGrammar & grammar)
+          : XmlParser(grammar),
+            event(NONE),
+            end_pending(false),
+            name((const char *) 0, (size_t) 0),
+            text((const char *) 0, (size_t) 0),
+            attrs(0)
+        {
+            this->grammar = & grammar.item;
+        }
+
+        /// Start reading the given buffer, which must outlive the reader
+        void open(const char * buffer, int start_line = 1)
+        {
+            position = buffer;
+            line_number = start_line;
+            event = NONE;
+            end_pending = false;
+            attrs = 0;
+            clear_elements();
+        }
+
+        /// Parse the next event
+        Event next()
+        {
+            if (end_pending)
+            {
+                end_pending = false;
+                return event = END_ELEMENT;
+            }
+
+            event = NONE;
+            while (event == NONE)
+            {
+                skip();
+                if (end())
+                {
+                    on_end_of_file();
+                    event = END_DOCUMENT;
+                }
+                else
+                    ParserBase<char>::parse();
+            }
+            return event;
+        }
+
+        /// Go past the end of the element just started, without parsing its content
+        /// The current event becomes the END_ELEMENT of this element.
+        void skip_element()
+        {
+            assert(event == START_ELEMENT);
+            if (end_pending)
+                end_pending = false;
+            else
+                XmlParser::skip_element();
+            event = END_ELEMENT;
+        }
+
+        Event get_event() const { return event; }
+
+        /// Name of the element, for START_ELEMENT and END_ELEMENT events
+        const ell::string & get_name() const { return name; }
+
+        /// Attributes of the element, for START_ELEMENT events
+        const XmlAttributeViews & get_attributes() const
+        {
+            assert(event == START_ELEMENT);
+            return * attrs;
+        }
+
+        /// Value of the given attribute of the element, or null if absent
+        const ell::string * get_attrib(const ell::string & attr_name) const
+        {
+            XmlAttributeViews::const_iterator i = get_attributes().find(attr_name);
+            return i == attrs->end() ? 0 : & i->second;
+        }
+
+        /// Text, for TEXT events
+        const ell::string & get_text() const { return text; }
+
+        /// Number of elements opened
+        using XmlParser::depth;
+
+    private:
+        void on_start_element(const ell::string & n, const XmlAttributeViews & a)
+        {
+            event = START_ELEMENT;
+            name = n;
+            attrs = & a;
+        }
+
+        void on_end_element(const ell::string & n)
+        {
+            // Single element: report its end on the next call
+            if (event == START_ELEMENT)
+                end_pending = true;
+            else
+            {
+                event = END_ELEMENT;
+                name = n;
+            }
+        }
+
+        void on_data_view(const ell::string & data)
+        {
+            event = TEXT;
+            text = data;
+        }
+
+        Event event;
+        bool end_pending;
+        ell::string name, text;
+        const XmlAttributeViews * attrs;
+    };
+}
+
+#endif // INCLUDED_ELL_XMLREADER_H
@@ -0,0 +1,127 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLSCAN_H
+#define INCLUDED_ELL_XMLSCAN_H
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include <ell/Node.h>
+
+// Reads beyond the terminating null are legitimate in xml_find(), but
+// not for AddressSanitizer nor ThreadSanitizer
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#   define ELL_XML_NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+#elif defined(__has_feature)
+#   if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#       define ELL_XML_NO_SANITIZE __attribute__((no_sanitize("address", "thread")))
+#   endif
+#endif
+#ifndef ELL_XML_NO_SANITIZE
+#   define ELL_XML_NO_SANITIZE
+#endif
+
+namespace ell
+{
+    /// Return the first character of the null-terminated buffer from p which
+    /// is in the given set (4 characters at most) or is the terminating null,
+    /// and add the number of newlines before it to `lines`
+    ///
+    /// With SSE2, the buffer is read by aligned blocks of 16 bytes: bytes after
+    /// the null terminator of the last block are read, which never crosses a
+    /// page boundary. Such reads are not instrumented by sanitizers.
+    const char * xml_find(const char * p, const char * stops, int & lines);
+
+    /// First stage of XML parsing: bitmaps of structural characters
+    /// (`<>&"'`) and newlines of a buffer, built 16 bytes at a time with SSE2
+    ///
+    /// The grammar then jumps from one structural character to the next one
+    /// instead of testing every byte, and counts lines with popcount.
+    struct XmlStructuralIndex
+    {
+        XmlStructuralIndex()
+          : base(0), size(0)
+        { }
+
+        void build(const char * buffer, size_t size);
+
+        void clear()
+        {
+            base = 0;
+            size = 0;
+            structural.clear();
+            newlines.clear();
+        }
+
+        bool contains(const char * p) const { return p >= base && p <= base + size; }
+
+        /// Same as xml_find() for characters in the buffer, if stops are
+        /// all structural characters
+        const char * find(const char * p, const char * stops, int & lines) const;
+
+        const char * base;
+        size_t size;
+        std::vector<uint64_t> structural, newlines;
+
+    private:
+        /// First set bit at or after position i, or size
+        size_t next(const std::vector<uint64_t> & bits, size_t i) const;
+
+        /// Number of set bits in [begin, end)
+        static int count(const std::vector<uint64_t> & bits, size_t begin, size_t end);
+    };
+
+    /// Grammar primitive consuming a run of characters at once
+    ///
+    /// Either up to one of the stop characters, matching if at least one
+    /// character is consumed, or up to (not including) the terminator,
+    /// matching if it is found.
+    struct XmlJump : public ConcreteNodeBase<char, XmlJump>
+    {
+        XmlJump(const char * stops, const char * terminator = "")
+          : stops(stops), terminator(terminator)
+        { }
+
+        using ConcreteNodeBase<char, XmlJump>::match;
+        bool match(Parser<char> * parser, Storage<void> &) const;
+
+        std::string get_kind() const { return "jump"; }
+        std::string get_value() const { return terminator.empty() ? stops : terminator; }
+
+        std::string stops, terminator;
+    };
+
+    /// Grammar primitive consuming a text run, up to a reference or a tag
+    ///
+    /// Blanks before a tag are not part of the run: they are left to the
+    /// enclosing rule. Every character is read at most twice, whatever the
+    /// length of blank runs.
+    struct XmlText : public ConcreteNodeBase<char, XmlText>
+    {
+        using ConcreteNodeBase<char, XmlText>::match;
+        bool match(Parser<char> * parser, Storage<void> &) const;
+
+        std::string get_kind() const { return "text"; }
+        std::string get_value() const { return ""; }
+    };
+}
+
+#endif // INCLUDED_ELL_XMLSCAN_H
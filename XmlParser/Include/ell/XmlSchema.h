@@ -0,0 +1,212 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLSCHEMA_H
+#define INCLUDED_ELL_XMLSCHEMA_H
+
+#include <stdint.h>
+
+#include <ell/XmlParser.h>
+
+namespace ell
+{
+    /// Content model of an element, compiled into a DFA on element names
+    struct XmlContentModel
+    {
+        static const uint32_t dead = 0xFFFFFFFF;
+
+        XmlContentModel()
+          : any(false), mixed(false), width(0)
+        { }
+
+        /// Next state after a child element whose name has the given id
+        /// in the schema table, or dead if it is not allowed
+        uint32_t next(uint32_t state, uint32_t id) const
+        {
+            return id < width ? transitions[state * width + id] : dead;
+        }
+
+        /// ANY: all declared elements and text are allowed
+        bool any;
+
+        /// Text is allowed
+        bool mixed;
+
+        /// Ids of names known when compiling, the others cannot be children
+        uint32_t width;
+
+        /// Rows of width next states, state 0 being the initial one
+        std::vector<uint32_t> transitions;
+        std::vector<bool> accepting;
+
+        /// Attributes which must be present
+        std::vector<XmlName> required;
+
+        /// Declaration, for error messages
+        std::string source;
+    };
+
+    /// Set of element declarations, with content models in DTD syntax:
+    ///   - `EMPTY`, `ANY`
+    ///   - mixed content: `(#PCDATA)` or `(#PCDATA | a | b)*`
+    ///   - children: names grouped by `( , )` sequences and `( | )` choices,
+    ///     with `?`, `*` and `+` occurrences, like `(head, (p | list)*, foot?)`
+    ///
+    /// Each content model is compiled once into a DFA, so that validation
+    /// costs a table lookup per element.
+    struct XmlSchema
+    {
+        XmlSchema() { }
+
+        /// Raise a std::runtime_error if the content model is not valid
+        void element(const std::string & name, const std::string & content_model);
+
+        /// The element must have been declared
+        void require_attribute(const std::string & element, const std::string & attribute);
+
+        /// Name of the root element, any declared element by default
+        void set_root(const std::string & name) { root = names.intern(name); }
+
+        /// Model of the given element, or null if it is not declared
+        const XmlContentModel * model(const XmlName & name) const
+        {
+            uint32_t id = name.id();
+            return id < models_by_id.size() && models_by_id[id] != XmlContentModel::dead ?
+                & models[models_by_id[id]] : 0;
+        }
+
+        /// Names of declared elements and their children, which give the DFA symbols
+        XmlNameTable names;
+
+        XmlName root;
+
+    private:
+        XmlContentModel & declared(const std::string & name);
+
+        std::vector<uint32_t> models_by_id;
+        std::deque<XmlContentModel> models;
+
+        /// Forbidden
+        XmlSchema(const XmlSchema &);
+        void operator = (const XmlSchema &);
+    };
+
+    /// Validation state of a document being parsed
+    struct XmlValidation
+    {
+        explicit XmlValidation(const XmlSchema & schema)
+          : schema(schema)
+        { }
+
+        void reset() { stack.clear(); }
+
+        //@{
+        /// Parsing events, raise errors through the given parser
+        void start_element(const Parser<char> & parser, const ell::string & name, const XmlAttributeViews & attrs);
+        void end_element(const Parser<char> & parser);
+        void data(const Parser<char> & parser, const ell::string & data);
+        //@}
+
+        const XmlSchema & schema;
+
+    private:
+        struct Frame
+        {
+            const XmlContentModel * model;
+            uint32_t state;
+        };
+
+        std::vector<Frame> stack;
+    };
+
+    /// Parser validating documents against a schema while giving the events
+    /// to Base, which handles them (XmlDomParser, XmlTapeParser...)
+    /// An invalid document is rejected on the first unexpected event.
+    /// Filters and records of XmlDomParser are not supported.
+    template <typename Base>
+    struct XmlValidating : public Base
+    {
+        XmlValidating(XmlGrammar & grammar, const XmlSchema & schema)
+          : Base(grammar), validation(schema)
+        { }
+
+        void parse(const char * buffer, int start_line = 1)
+        {
+            validation.reset();
+            Base::parse(buffer, start_line);
+        }
+
+        void parse_insitu(char * buffer, int start_line = 1)
+        {
+            validation.reset();
+            Base::parse_insitu(buffer, start_line);
+        }
+
+        void on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
+        {
+            validation.start_element(* this, name, attrs);
+            Base::on_start_element(name, attrs);
+        }
+
+        void on_end_element(const ell::string & name)
+        {
+            validation.end_element(* this);
+            Base::on_end_element(name);
+        }
+
+        void on_data_view(const ell::string & data)
+        {
+            validation.data(* this, data);
+            Base::on_data_view(data);
+        }
+
+        XmlValidation validation;
+    };
+
+    /// Parser only validating documents against a schema
+    struct XmlValidator : public XmlParser
+    {
+        XmlValidator(XmlGrammar & grammar, const XmlSchema & schema)
+          : XmlParser(grammar), validation(schema)
+        { }
+
+        void parse(const char * buffer, int start_line = 1)
+        {
+            validation.reset();
+            XmlParser::parse(buffer, start_line);
+        }
+
+        void on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
+        {
+            validation.start_element(* this, name, attrs);
+        }
+
+        void on_end_element(const ell::string &)
+        {
+            validation.end_element(* this);
+        }
+
+        void on_data_view(const ell::string & data)
+        {
+            validation.data(* this, data);
+        }
+
+        XmlValidation validation;
+    };
+}
+
+#include <ell/impl/XmlSchema.h>
+
+#endif // INCLUDED_ELL_XMLSCHEMA_H
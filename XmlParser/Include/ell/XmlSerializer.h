@@ -0,0 +1,236 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ell/XmlParser.h>
+
+#ifndef INCLUDED_ELL_XMLSERIALIZER_H
+#define INCLUDED_ELL_XMLSERIALIZER_H
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define ELL_XML_WRITEV 1
+#   include <errno.h>
+#   include <limits.h>
+#   include <sys/uio.h>
+#   include <unistd.h>
+#endif
+
+namespace ell
+{
+    /// Byte buffer where XML is serialized
+    ///
+    /// Writes are copies into a buffer, which is given to the sink by flush().
+    /// This base class has no sink: the buffer grows, and is the result.
+    /// Only write_ref() may keep a pointer to the caller's bytes.
+    struct XmlOutput
+    {
+        XmlOutput(size_t capacity = 64 * 1024)
+          : buffer(capacity), used(0), large((size_t) -1)
+        { }
+
+        virtual ~XmlOutput() { }
+
+        void put(char c)
+        {
+            if (used == buffer.size())
+                overflow(& c, 1);
+            else
+                buffer[used++] = c;
+        }
+
+        void write(const char * s, size_t size)
+        {
+            if (size > buffer.size() - used || size >= large)
+                overflow(s, size);
+            else
+            {
+                memcpy(& buffer[used], s, size);
+                used += size;
+            }
+        }
+
+        void write(const ell::string & s) { write(s.position, s.size()); }
+        void write(const std::string & s) { write(s.data(), s.size()); }
+
+        /// Write bytes which stay valid and unchanged until the next flush()
+        /// Outputs which can give them to the sink from their own place do
+        /// not copy them, others just write() them.
+        virtual void write_ref(const char * s, size_t size) { write(s, size); }
+        void write_ref(const ell::string & s) { write_ref(s.position, s.size()); }
+        void write_ref(const std::string & s) { write_ref(s.data(), s.size()); }
+
+        /// Give buffered bytes to the sink
+        virtual void flush() { }
+
+        //@{
+        /// Buffered bytes
+        const char * data() const { return used ? & buffer[0] : ""; }
+        size_t size() const { return used; }
+        std::string str() const { return std::string(data(), used); }
+        //@}
+
+        /// Forget buffered bytes
+        void clear() { used = 0; }
+
+    protected:
+        /// Called when the given bytes do not fit in the buffer,
+        /// or are large
+        /// The bytes belong to the caller: they must not be used after return.
+        virtual void overflow(const char * s, size_t size)
+        {
+            buffer.resize(std::max(buffer.size() * 2, used + size));
+            memcpy(& buffer[used], s, size);
+            used += size;
+        }
+
+        std::vector<char> buffer;
+        size_t used;
+
+        /// Size from which writes are given to overflow()
+        size_t large;
+    };
+
+    /// Output to a std::ostream, by blocks
+    struct XmlStreamOutput : public XmlOutput
+    {
+        XmlStreamOutput(std::ostream & os, size_t capacity = 16 * 1024)
+          : XmlOutput(capacity), os(os)
+        {
+            large = capacity;
+        }
+
+        ~XmlStreamOutput() { flush(); }
+
+        void flush()
+        {
+            os.write(data(), used);
+            used = 0;
+        }
+
+    protected:
+        void overflow(const char * s, size_t size)
+        {
+            flush();
+            if (size >= large)
+                os.write(s, size);
+            else
+                write(s, size);
+        }
+
+        std::ostream & os;
+    };
+
+#if ELL_XML_WRITEV
+    /// Output to a file descriptor, with a single writev() for many blocks
+    ///
+    /// Strings given to write_ref() from the threshold size are not copied:
+    /// they are written from their own place at the next flush().
+    /// Errors raise a std::runtime_error.
+    struct XmlFdOutput : public XmlOutput
+    {
+        XmlFdOutput(int fd, size_t capacity = 256 * 1024, size_t threshold = 4096)
+          : XmlOutput(capacity), fd(fd), threshold(threshold), segment_begin(0)
+        { }
+
+        ~XmlFdOutput()
+        {
+            try
+            {
+                flush();
+            }
+            catch (std::runtime_error &)
+            { }
+        }
+
+        void flush();
+
+        void write_ref(const char * s, size_t size);
+
+    protected:
+        void overflow(const char * s, size_t size);
+
+        /// Close the segment of the buffer not yet in the vector
+        void close_segment();
+
+        int fd;
+
+        /// Size from which write_ref() does not copy
+        size_t threshold;
+
+        size_t segment_begin;
+        std::vector<struct iovec> segments;
+    };
+#endif
+
+    /// DOM serialization in a XmlOutput, without allocation
+    ///
+    /// Strings of the DOM are given to XmlOutput::write_ref(): the DOM must
+    /// not change until the output is flushed. Other strings are copied.
+    struct XmlSerializer
+    {
+        XmlSerializer(XmlOutput & out)
+          : out(out)
+        { }
+
+        /// Without any blank: `<a x="1"><b/>text</a>`
+        void write_compact(const XmlNode & node);
+
+        /// Same output as XmlNode::unparse()
+        void write_pretty(const XmlNode & node, int indent = 0, int shift = 1);
+
+        //@{
+        /// Escaped strings
+        /// Pretty mode escapes the five XML special characters like
+        /// XmlGrammar::protect(), compact mode only the required ones.
+        void write_text(const char * s, size_t size, bool pretty = false);
+        void write_attribute_value(const char * s, size_t size, bool pretty = false);
+        //@}
+
+        void write_indent(size_t n);
+
+        /// Return the first character of [begin, end) found in the given
+        /// table of 256 booleans, or end
+        /// Table entries may be set only for characters of `"'&<>`.
+        static const char * find_special(const char * begin, const char * end, const bool * table);
+
+        /// Entity of one of the characters `"'&<>`
+        static const char * entity(char c);
+
+        /// Write the given string with the characters of the table escaped
+        /// Unescaped parts are given to write_ref() if the string is stable
+        /// until the next flush().
+        static void escape(XmlOutput & out, const char * s, size_t size, const bool * table,
+                           bool stable = false);
+
+        //@{
+        /// Tables of characters to escape
+        static const bool * all_specials();
+        static const bool * text_specials();
+        static const bool * attribute_specials();
+        //@}
+
+        XmlOutput & out;
+
+    private:
+        static const bool * make_table(bool * table, const char * chars);
+    };
+}
+
+#include <ell/impl/XmlSerializer.h>
+
+#endif // INCLUDED_ELL_XMLSERIALIZER_H
@@ -0,0 +1,124 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_XMLSNAPSHOT_H
+#define INCLUDED_ELL_XMLSNAPSHOT_H
+
+#include <cstdio>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define ELL_XML_MMAP 1
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+#include <ell/XmlTape.h>
+
+namespace ell
+{
+    /// Header of a snapshot file
+    ///
+    /// The file is the header followed by the records, the attributes and
+    /// the string heap of the tape, as laid out in memory: it is only
+    /// portable between machines of the same endianness, which the version
+    /// field checks.
+    struct XmlSnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+
+        /// FNV-1a of the header, computed with this field set to 0
+        uint32_t checksum;
+
+        //@{
+        /// Source file stamp
+        uint64_t source_size;
+        int64_t source_mtime;
+        //@}
+
+        uint64_t records, attributes, strings;
+
+        uint32_t compute_checksum() const;
+    };
+
+    /// Binary image of a XmlTape, used without deserialization
+    ///
+    /// A snapshot is tied to the XML file it was parsed from: it is rejected
+    /// when the size or modification time of that file changed.
+    ///
+    ///     XmlSnapshot s;
+    ///     if (! s.open("data.xml.tape", "data.xml"))
+    ///     {
+    ///         XmlTapeParser p(grammar);
+    ///         p.parse(read_file("data.xml"));
+    ///         XmlSnapshot::save(p.tape, "data.xml.tape", "data.xml");
+    ///         ...
+    ///     }
+    ///     XmlTapeNode root = s.get_root();
+    struct XmlSnapshot
+    {
+        XmlSnapshot()
+          : map(0), map_size(0)
+        { }
+
+        ~XmlSnapshot() { close(); }
+
+        /// Write the tape to the given file, stamped after the source file
+        /// Return false if the source does not exist or the file cannot be written.
+        static bool save(const XmlTape & tape, const char * path, const char * source_path);
+
+        /// Map the given snapshot
+        /// Return false if it does not exist, is corrupted, or is out of date
+        /// with respect to the source file. Links, attribute indices and
+        /// string ranges of the whole body are checked once here, so that
+        /// nodes read it without bound checks.
+        bool open(const char * path, const char * source_path);
+
+        void close();
+
+        bool is_open() const { return map != 0; }
+
+        /// Document node is not the XML root element
+        XmlTapeNode get_root() const { return tape.document().first_child(); }
+
+        /// Read-only view on the mapped memory
+        XmlTape tape;
+
+    private:
+        /// Size and modification time of the given file
+        static bool stamp(const char * path, uint64_t & size, int64_t & mtime);
+
+        /// Check the sizes given by the header against the body size,
+        /// then every index and string range of the body
+        static bool check(const XmlSnapshotHeader & h, const char * body, size_t size);
+
+        const char * map;
+        size_t map_size;
+
+        /// Storage when memory mapping is not available
+        std::vector<char> buffer;
+
+        /// Forbidden: the tape refers to the mapping
+        XmlSnapshot(const XmlSnapshot &);
+        void operator = (const XmlSnapshot &);
+    };
+}
+
+#include <ell/impl/XmlSnapshot.h>
+
+#endif // INCLUDED_ELL_XMLSNAPSHOT_H
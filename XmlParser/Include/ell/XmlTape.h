@@ -0,0 +1,350 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLTAPE_H
+#define INCLUDED_ELL_XMLTAPE_H
+
+#include <stdint.h>
+
+#include <ell/XmlParser.h>
+#include <ell/XmlSerializer.h>
+
+namespace ell
+{
+    struct XmlTape;
+    struct XmlTapeNode;
+
+    /// Iterator through XmlTapeNode children, with the same semantics as XmlIterator
+    struct XmlTapeIterator
+    {
+        explicit XmlTapeIterator(const XmlTape * tape = 0, uint32_t pos = 0xFFFFFFFF)
+          : tape(tape), current(pos)
+        { }
+
+        XmlTapeNode operator * () const;
+
+        operator bool () const
+        {
+            return current != 0xFFFFFFFF;
+        }
+
+        XmlTapeIterator & operator ++ ();
+        XmlTapeIterator & operator -- ();
+
+        XmlTapeIterator operator ++ (int);
+        XmlTapeIterator operator -- (int);
+
+        XmlTapeIterator operator + (int inc) const;
+        XmlTapeIterator operator - (int dec) const;
+
+    private:
+        const XmlTape * tape;
+        uint32_t current;
+    };
+
+    /// Light handle on a node of a XmlTape, giving the read-only part of the XmlNode API
+    struct XmlTapeNode
+    {
+        XmlTapeNode(const XmlTape * tape, uint32_t index)
+          : tape(tape), index(index)
+        { }
+
+        //@{
+        /// Kind of node enquirement
+        bool is_element() const;
+        bool is_data() const { return ! is_element(); }
+        //@}
+
+        //@{
+        /// Attribute handling, raise error if attribute does not exist
+        ell::string get_attrib(const ell::string & name) const;
+
+        template <typename T>
+        T get_attrib(const ell::string & name) const;
+
+        const XmlTapeNode & check_attrib(const ell::string & name, const ell::string & value) const;
+        bool has_attrib(const ell::string & name) const;
+        //@}
+
+        //@{
+        /// Element name handling, raise error if not an element
+        ell::string get_name() const;
+        const XmlTapeNode & check_name(const ell::string & name) const;
+        //@}
+
+        //@{
+        /// Data handling, raise error if it is an element
+        ell::string get_data() const;
+        const XmlTapeNode & check_data(const ell::string & data) const;
+        //@}
+
+        /// Concatenation of children data nodes
+        void get_text(std::string & s) const;
+
+        //@{
+        /// Tree walking
+        /// If the targetted node does not exist, raise an error
+        XmlTapeNode next_sibling() const;
+        XmlTapeNode previous_sibling() const;
+        XmlTapeNode first_child() const;
+        XmlTapeNode last_child() const;
+        XmlTapeNode parent() const;
+        //@}
+
+        XmlTapeIterator first() const;
+        XmlTapeIterator last() const;
+
+        /// Recursive write of resulting XML, like XmlNode::unparse()
+        void unparse(std::ostream & out, int indent = 0, int shift = 1) const;
+
+        /// Same output through the given serializer
+        void write_pretty(XmlSerializer & serializer, int indent = 0, int shift = 1) const;
+
+        friend std::ostream & operator << (std::ostream & os, const XmlTapeNode & node)
+        {
+            node.unparse(os);
+            return os;
+        }
+
+        /// Dump a visual representation of the DOM tree
+        void dump(std::ostream & out, int indent = 0, int shift = 1) const;
+
+        /// Textual representation of the node
+        std::string describe() const;
+
+        /// Line information in the original file
+        int line() const;
+
+        void raise_error(const std::string & msg) const;
+
+        const XmlTape * tape;
+        uint32_t index;
+    };
+
+    /// Compact read-only DOM
+    ///
+    /// Nodes are stored in document order in one contiguous array, linked by
+    /// 32-bit indices: the first child of a node, if any, immediately follows it.
+    /// Strings live in a side heap (or in the parsed buffer when built in situ),
+    /// and attributes in a side array, also in document order.
+    ///
+    /// Node 0 is the document node, like XmlDomParser::document.
+    ///
+    /// Nodes read the arrays through plain pointers, which either refer to the
+    /// vectors filled by XmlTapeParser, or to external memory such as a mapped
+    /// XmlSnapshot.
+    struct XmlTape
+    {
+        static const uint32_t npos = 0xFFFFFFFF;
+
+        /// Set in Record::line for data nodes
+        static const uint32_t data_flag = 0x80000000;
+
+        /// Location of a string in the heap
+        struct String
+        {
+            uint32_t offset, size;
+        };
+
+        struct Record
+        {
+            uint32_t parent, previous_sibling, next_sibling, last_child;
+
+            /// First attribute of this node, the last one being before
+            /// the first attribute of the next node
+            uint32_t attributes;
+
+            /// Name of an element, or text of a data node
+            String text;
+
+            /// Line in the original file, with data_flag for data nodes
+            uint32_t line;
+        };
+
+        struct Attribute
+        {
+            String name, value;
+        };
+
+        XmlTape()
+          : heap(0)
+        {
+            clear();
+        }
+
+        XmlTape(const XmlTape & other)
+          : records(other.records),
+            attributes(other.attributes),
+            strings(other.strings)
+        {
+            copy_view(other);
+        }
+
+        XmlTape & operator = (const XmlTape & other)
+        {
+            if (this != & other)
+            {
+                records = other.records;
+                attributes = other.attributes;
+                strings = other.strings;
+                copy_view(other);
+            }
+            return * this;
+        }
+
+        /// Document node
+        XmlTapeNode document() const { return XmlTapeNode(this, 0); }
+
+        /// Number of nodes, including the document one
+        size_t size() const { return record_count; }
+
+        const Record & record(uint32_t i) const { return record_data[i]; }
+
+        ell::string get_string(const String & s) const
+        {
+            return ell::string(heap + s.offset, (size_t) s.size);
+        }
+
+        //@{
+        /// Attributes of node i are in [attributes_begin(i), attributes_end(i))
+        const Attribute * attributes_begin(uint32_t i) const
+        {
+            return attribute_count ? attribute_data + record_data[i].attributes : 0;
+        }
+
+        const Attribute * attributes_end(uint32_t i) const
+        {
+            if (! attribute_count)
+                return 0;
+            return attribute_data + (i + 1 < record_count ? record_data[i + 1].attributes : attribute_count);
+        }
+        //@}
+
+        void clear();
+
+        /// Make nodes read the vectors, after they were modified
+        void publish()
+        {
+            record_data = records.empty() ? 0 : & records[0];
+            record_count = records.size();
+            attribute_data = attributes.empty() ? 0 : & attributes[0];
+            attribute_count = attributes.size();
+        }
+
+        /// Make nodes read external arrays, which must outlive the tape
+        void attach(const Record * r, size_t nr, const Attribute * a, size_t na, const char * h)
+        {
+            records.clear();
+            attributes.clear();
+            strings.clear();
+            record_data = r;
+            record_count = nr;
+            attribute_data = a;
+            attribute_count = na;
+            heap = h;
+        }
+
+        /// Size of the part of the heap used by the tape
+        size_t heap_size() const;
+
+        //@{
+        /// Storage filled by XmlTapeParser
+        std::vector<Record> records;
+        std::vector<Attribute> attributes;
+
+        /// Storage of copied strings
+        std::vector<char> strings;
+        //@}
+
+        /// Base of string offsets: either the strings storage,
+        /// the buffer parsed in situ, or external memory
+        const char * heap;
+
+    private:
+        void copy_view(const XmlTape & other)
+        {
+            if (other.record_data == (other.records.empty() ? 0 : & other.records[0]))
+                publish();
+            else
+                attach(other.record_data, other.record_count, other.attribute_data, other.attribute_count, 0);
+
+            if (! other.strings.empty() && other.heap == & other.strings[0])
+                heap = & strings[0];
+            else
+                heap = other.heap;
+        }
+
+        const Record * record_data;
+        size_t record_count;
+        const Attribute * attribute_data;
+        size_t attribute_count;
+    };
+
+    /// SAX parser building a XmlTape
+    ///
+    /// When parsing in situ, no string is copied: they all point inside
+    /// the parsed buffer.
+    /// Documents whose strings or nodes do not fit the 32-bit indices of
+    /// the tape raise an error.
+    struct XmlTapeParser : public XmlParser
+    {
+        XmlTapeParser(XmlGrammar & grammar)
+          : XmlParser(grammar)
+        { }
+
+        void parse(const char * buffer, int start_line = 1)
+        {
+            begin_tape();
+            XmlParser::parse(buffer, start_line);
+            tape.heap = tape.strings.empty() ? 0 : & tape.strings[0];
+            tape.publish();
+        }
+
+        void parse_insitu(char * buffer, int start_line = 1)
+        {
+            begin_tape();
+            tape.heap = buffer;
+            XmlParser::parse_insitu(buffer, start_line);
+            tape.publish();
+        }
+
+        /// Document node is not the XML root element
+        XmlTapeNode get_root() const { return tape.document().first_child(); }
+
+        XmlTape tape;
+
+        void on_start_element(const ell::string & name, const XmlAttributeViews & attrs);
+        void on_end_element(const ell::string &);
+        void on_data_view(const ell::string & data);
+
+    private:
+        void begin_tape()
+        {
+            tape.clear();
+            current = 0;
+        }
+
+        /// Copy the string in the heap if not parsing in situ
+        XmlTape::String store(const char * s, size_t size);
+
+        uint32_t append(const XmlTape::String & text, bool element);
+
+        uint32_t current;
+    };
+}
+
+#include <ell/impl/XmlTape.h>
+
+#endif // INCLUDED_ELL_XMLTAPE_H
@@ -0,0 +1,77 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_XMLWRITER_H
+#define INCLUDED_ELL_XMLWRITER_H
+
+#include <ell/XmlSerializer.h>
+
+namespace ell
+{
+    /// Streaming XML generation, without DOM
+    ///
+    ///     XmlOutput out;
+    ///     XmlWriter w(out);
+    ///     w.start_element("a").attribute("x", "1").text("hi").end_element();
+    ///
+    /// Only the names of opened elements are kept, so memory is bounded by
+    /// the nesting depth. Strings are escaped like XmlGrammar::protect().
+    /// Strings are copied with XmlOutput::write(), never referenced, so the
+    /// caller may reuse its buffers as soon as a call returns.
+    /// Misuses raise a std::runtime_error.
+    struct XmlWriter
+    {
+        /// In pretty mode, the output is the same as XmlNode::unparse()
+        XmlWriter(XmlOutput & out, bool pretty = false, int shift = 1)
+          : serializer(out), pretty(pretty), shift(shift), tag_open(false)
+        { }
+
+        XmlWriter & start_element(const ell::string & name);
+
+        /// Only allowed right after start_element() or attribute()
+        XmlWriter & attribute(const ell::string & name, const ell::string & value);
+
+        XmlWriter & text(const ell::string & data);
+
+        XmlWriter & end_element();
+
+        /// Check that every element is closed, and flush the output
+        void finish();
+
+        /// Number of opened elements
+        size_t depth() const { return offsets.size(); }
+
+    private:
+        /// Terminate the start tag before some content
+        void close_tag();
+
+        XmlSerializer serializer;
+        bool pretty;
+        int shift;
+
+        /// A start tag is waiting for its `>`
+        bool tag_open;
+
+        //@{
+        /// Names of opened elements, one after the other
+        std::string names;
+        std::vector<size_t> offsets;
+        //@}
+    };
+}
+
+#include <ell/impl/XmlWriter.h>
+
+#endif // INCLUDED_ELL_XMLWRITER_H
@@ -0,0 +1,108 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_IMPL_XMLBINDING_H
+#define INCLUDED_ELL_IMPL_XMLBINDING_H
+
+namespace ell
+{
+    inline XmlBindingBase::~XmlBindingBase()
+    {
+        for (size_t i = 0; i < children.size(); ++i)
+            delete children[i];
+        for (size_t i = 0; i < attributes.size(); ++i)
+            delete attributes[i];
+        for (size_t i = 0; i < owned.size(); ++i)
+            delete owned[i];
+        delete text_setter;
+    }
+
+    inline void XmlBindingBase::add_child(const std::string & name, Child * child)
+    {
+        uint32_t id = element_names.intern(ell::string(name)).id();
+        if (id > children.size())
+            children.resize(id, 0);
+        delete children[id - 1];
+        children[id - 1] = child;
+    }
+
+    inline void XmlBindingBase::add_attribute(const std::string & name, Setter * setter)
+    {
+        uint32_t id = attribute_names.intern(ell::string(name)).id();
+        if (id > attributes.size())
+            attributes.resize(id, 0);
+        delete attributes[id - 1];
+        attributes[id - 1] = setter;
+    }
+
+    inline void XmlBindingBase::set_text(Setter * setter)
+    {
+        delete text_setter;
+        text_setter = setter;
+    }
+
+    inline void XmlBinder::on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
+    {
+        Frame f;
+        if (frames.empty())
+        {
+            if (name != root_name)
+                raise_error("Unexpected root element `" + name + "`, expecting `" + root_name + "`", line_number);
+            f.binding = root_binding;
+            f.object = root_object;
+        }
+        else
+        {
+            const XmlBindingBase::Child * child = frames.back().binding->find_child(name);
+            if (! child)
+            {
+                skip_current_element();
+                return;
+            }
+            f.binding = child->binding;
+            f.object = child->enter(frames.back().object);
+        }
+
+        for (XmlAttributeViews::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            const XmlBindingBase::Setter * setter = f.binding->find_attribute(i->first);
+            if (setter && ! setter->set(f.object, i->second.position, i->second.position + i->second.size()))
+                raise_error("Wrong type for attribute " + i->first + "=\"" + i->second + "\"", line_number);
+        }
+
+        f.text_begin = text.size();
+        frames.push_back(f);
+    }
+
+    inline void XmlBinder::on_end_element(const ell::string & name)
+    {
+        const Frame & f = frames.back();
+        if (f.binding->text_setter && text.size() > f.text_begin &&
+            ! f.binding->text_setter->set(f.object, text.data() + f.text_begin, text.data() + text.size()))
+            raise_error("Wrong type for the text of element `" + name + "`", line_number);
+
+        text.resize(f.text_begin);
+        frames.pop_back();
+    }
+
+    inline void XmlBinder::on_data_view(const ell::string & data)
+    {
+        if (! frames.empty() && frames.back().binding->text_setter)
+            text.append(data.position, data.size());
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLBINDING_H
@@ -0,0 +1,190 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_IMPL_XMLCONVERT_H
+#define INCLUDED_ELL_IMPL_XMLCONVERT_H
+
+namespace ell
+{
+    namespace
+    {
+        inline bool xml_is_blank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        inline void xml_trim(const char * & begin, const char * & end)
+        {
+            while (begin != end && xml_is_blank(* begin))
+                ++begin;
+            while (begin != end && xml_is_blank(end[-1]))
+                --end;
+        }
+
+        /// Decimal integer with optional sign, checked for overflow
+        template <typename T>
+        bool xml_convert_integer(const char * p, const char * end, T & value)
+        {
+            xml_trim(p, end);
+            bool negative = false;
+            if (p != end && (* p == '-' || * p == '+'))
+                negative = * p++ == '-';
+            if (p == end || (negative && ! std::numeric_limits<T>::is_signed))
+                return false;
+
+            T v = 0;
+            const T limit = negative ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+            for (; p != end; ++p)
+            {
+                T d = (T) (* p - '0');
+                if (* p < '0' || * p > '9')
+                    return false;
+                if (negative)
+                {
+                    if (v < (limit + d) / 10)
+                        return false;
+                    v = v * 10 - d;
+                }
+                else
+                {
+                    if (v > (limit - d) / 10)
+                        return false;
+                    v = v * 10 + d;
+                }
+            }
+            value = v;
+            return true;
+        }
+    }
+
+#   define D(T)                                                                 \
+    inline bool xml_convert(const char * begin, const char * end, T & value)   \
+    {                                                                           \
+        return xml_convert_integer(begin, end, value);                         \
+    }
+    D(short)
+    D(unsigned short)
+    D(int)
+    D(unsigned int)
+    D(long)
+    D(unsigned long)
+    D(long long)
+    D(unsigned long long)
+#   undef D
+
+    inline bool xml_convert(const char * begin, const char * end, double & value)
+    {
+        xml_trim(begin, end);
+        const char * p = begin;
+        bool negative = p != end && * p == '-';
+        if (p != end && (* p == '-' || * p == '+'))
+            ++p;
+
+        // Fast path: the result is exact if the mantissa fits in 53 bits
+        // and the power of ten is exactly representable
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool exact = true;
+        for (; p != end && * p >= '0' && * p <= '9'; ++p, ++digits)
+        {
+            if (mantissa < ((uint64_t) 1 << 53) / 10)
+                mantissa = mantissa * 10 + (* p - '0');
+            else
+                exact = false;
+        }
+        if (p != end && * p == '.')
+        {
+            for (++p; p != end && * p >= '0' && * p <= '9'; ++p, ++digits)
+            {
+                if (mantissa < ((uint64_t) 1 << 53) / 10)
+                {
+                    mantissa = mantissa * 10 + (* p - '0');
+                    --exponent;
+                }
+                else
+                    exact = false;
+            }
+        }
+        if (p != end && (* p == 'e' || * p == 'E') && digits)
+        {
+            int e;
+            const char * q = p + 1;
+            while (q != end && * q != ' ')
+                ++q;
+            if (! xml_convert_integer(p + 1, q, e) || e > 10000 || e < -10000)
+                return false;
+            exponent += e;
+            p = q;
+        }
+
+        if (p == end && digits)
+        {
+            static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                              1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+            if (exact && exponent >= -22 && exponent <= 22)
+            {
+                double v = (double) mantissa;
+                v = exponent < 0 ? v / powers[- exponent] : v * powers[exponent];
+                value = negative ? - v : v;
+                return true;
+            }
+        }
+        else if (p != begin + (p != begin && (* begin == '-' || * begin == '+')))
+        {
+            // Neither a number nor a special value such as inf or nan
+            return false;
+        }
+
+        // Slow path through strtod, with the decimal point of the C locale
+        std::string s(begin, end);
+        std::string::size_type dot = s.find('.');
+        if (dot != std::string::npos)
+            s[dot] = * localeconv()->decimal_point;
+        char * stop;
+        value = strtod(s.c_str(), & stop);
+        return * stop == 0 && stop != s.c_str();
+    }
+
+    inline bool xml_convert(const char * begin, const char * end, float & value)
+    {
+        double d;
+        if (! xml_convert(begin, end, d))
+            return false;
+        value = (float) d;
+        return true;
+    }
+
+    inline bool xml_convert(const char * begin, const char * end, bool & value)
+    {
+        xml_trim(begin, end);
+        std::string::size_type size = end - begin;
+        if ((size == 4 && ! memcmp(begin, "true", 4)) || (size == 1 && * begin == '1'))
+            value = true;
+        else if ((size == 5 && ! memcmp(begin, "false", 5)) || (size == 1 && * begin == '0'))
+            value = false;
+        else
+            return false;
+        return true;
+    }
+
+    inline bool xml_convert(const char * begin, const char * end, std::string & value)
+    {
+        value.assign(begin, end);
+        return true;
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLCONVERT_H
@@ -0,0 +1,128 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_IMPL_XMLDIFF_H
+#define INCLUDED_ELL_IMPL_XMLDIFF_H
+
+namespace ell
+{
+    inline void xml_diff(const XmlNode & old_root, const XmlNode & new_root, std::vector<XmlDifference> & out)
+    {
+        XmlDiffer d(out);
+        if (XmlDiffer::match(old_root, new_root))
+        {
+            d.diff(old_root, new_root);
+        }
+        else
+        {
+            XmlDifference deleted = { XmlDifference::DELETED, & old_root, new_root._parent };
+            XmlDifference inserted = { XmlDifference::INSERTED, old_root._parent, & new_root };
+            out.push_back(deleted);
+            out.push_back(inserted);
+        }
+    }
+
+    inline bool XmlDiffer::same_content(const XmlNode & a, const XmlNode & b)
+    {
+        if (a.data != b.data || a.attributes.size() != b.attributes.size())
+            return false;
+
+        for (XmlAttributesMap::const_iterator i = a.attributes.begin(); i != a.attributes.end(); ++i)
+        {
+            XmlAttributesMap::const_iterator j = b.attributes.find(i->first);
+            if (j == b.attributes.end() || i->second != j->second)
+                return false;
+        }
+        return true;
+    }
+
+    inline void XmlDiffer::diff(const XmlNode & a, const XmlNode & b)
+    {
+        if (same(a, b))
+            return;
+
+        if (! same_content(a, b))
+            report(XmlDifference::CHANGED, & a, & b);
+        diff_children(a, b);
+    }
+
+    inline void XmlDiffer::diff_children(const XmlNode & a, const XmlNode & b)
+    {
+        std::vector<const XmlNode *> x, y;
+        for (const XmlNode * p = a._first_child; p; p = p->_next_sibling)
+            x.push_back(p);
+        for (const XmlNode * p = b._first_child; p; p = p->_next_sibling)
+            y.push_back(p);
+
+        // Common prefix and suffix
+        size_t i = 0, j = 0, nx = x.size(), ny = y.size();
+        while (i < nx && j < ny && same(* x[i], * y[j]))
+            ++i, ++j;
+        while (nx > i && ny > j && same(* x[nx - 1], * y[ny - 1]))
+            --nx, --ny;
+
+        // Hashes of the children left in each list
+        std::map<uint64_t, size_t> left_x, left_y;
+        for (size_t k = i; k < nx; ++k)
+            ++left_x[x[k]->hash()];
+        for (size_t k = j; k < ny; ++k)
+            ++left_y[y[k]->hash()];
+
+        while (i < nx && j < ny)
+        {
+            uint64_t hx = x[i]->hash(), hy = y[j]->hash();
+            if (same(* x[i], * y[j]))
+            {
+                --left_x[hx];
+                --left_y[hy];
+                ++i, ++j;
+            }
+            else if (left_y[hx])
+            {
+                // x[i] comes later: y[j] is new
+                report(XmlDifference::INSERTED, & a, y[j++]);
+                --left_y[hy];
+            }
+            else if (left_x[hy])
+            {
+                report(XmlDifference::DELETED, x[i++], & b);
+                --left_x[hx];
+            }
+            else
+            {
+                if (match(* x[i], * y[j]))
+                {
+                    diff(* x[i], * y[j]);
+                }
+                else
+                {
+                    report(XmlDifference::DELETED, x[i], & b);
+                    report(XmlDifference::INSERTED, & a, y[j]);
+                }
+                --left_x[hx];
+                --left_y[hy];
+                ++i, ++j;
+            }
+        }
+
+        for (; i < nx; ++i)
+            report(XmlDifference::DELETED, x[i], & b);
+        for (; j < ny; ++j)
+            report(XmlDifference::INSERTED, & a, y[j]);
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLDIFF_H
@@ -0,0 +1,242 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_IMPL_XMLENTITIES_H
+#define INCLUDED_ELL_IMPL_XMLENTITIES_H
+
+namespace ell
+{
+    inline size_t xml_encode_utf8(uint32_t code, char * out)
+    {
+        if (code < 0x80)
+        {
+            out[0] = (char) code;
+            return 1;
+        }
+        if (code < 0x800)
+        {
+            out[0] = (char) (0xC0 | (code >> 6));
+            out[1] = (char) (0x80 | (code & 0x3F));
+            return 2;
+        }
+        if (code < 0x10000)
+        {
+            out[0] = (char) (0xE0 | (code >> 12));
+            out[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+            out[2] = (char) (0x80 | (code & 0x3F));
+            return 3;
+        }
+        out[0] = (char) (0xF0 | (code >> 18));
+        out[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+        out[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+        out[3] = (char) (0x80 | (code & 0x3F));
+        return 4;
+    }
+
+    inline void XmlEntityTable::add(const std::string & name, const std::string & value)
+    {
+        std::vector<Entry>::iterator i = std::lower_bound(entries.begin(), entries.end(),
+                                                          std::make_pair(name.data(), name.size()), Less());
+        if (i != entries.end() && i->first == name)
+            i->second = value;
+        else
+            entries.insert(i, Entry(name, value));
+    }
+
+    inline const std::string * XmlEntityTable::find(const char * name, size_t size) const
+    {
+        std::vector<Entry>::const_iterator i = std::lower_bound(entries.begin(), entries.end(),
+                                                                std::make_pair(name, size), Less());
+        if (i == entries.end() || i->first.size() != size || memcmp(i->first.data(), name, size))
+            return 0;
+        return & i->second;
+    }
+
+    inline const XmlEntityTable & XmlEntityTable::html()
+    {
+        // Initialized by a single thread, the others wait for it
+        static const XmlEntityTable table = make_html();
+        return table;
+    }
+
+    inline XmlEntityTable XmlEntityTable::make_html()
+    {
+        static const struct
+        {
+            const char * name;
+            uint32_t code;
+        } html4[] = {
+            { "AElig", 198 }, { "Aacute", 193 }, { "Acirc", 194 }, { "Agrave", 192 },
+            { "Alpha", 913 }, { "Aring", 197 }, { "Atilde", 195 }, { "Auml", 196 }, { "Beta", 914 },
+            { "Ccedil", 199 }, { "Chi", 935 }, { "Dagger", 8225 }, { "Delta", 916 }, { "ETH", 208 },
+            { "Eacute", 201 }, { "Ecirc", 202 }, { "Egrave", 200 }, { "Epsilon", 917 },
+            { "Eta", 919 }, { "Euml", 203 }, { "Gamma", 915 }, { "Iacute", 205 }, { "Icirc", 206 },
+            { "Igrave", 204 }, { "Iota", 921 }, { "Iuml", 207 }, { "Kappa", 922 },
+            { "Lambda", 923 }, { "Mu", 924 }, { "Ntilde", 209 }, { "Nu", 925 }, { "OElig", 338 },
+            { "Oacute", 211 }, { "Ocirc", 212 }, { "Ograve", 210 }, { "Omega", 937 },
+            { "Omicron", 927 }, { "Oslash", 216 }, { "Otilde", 213 }, { "Ouml", 214 },
+            { "Phi", 934 }, { "Pi", 928 }, { "Prime", 8243 }, { "Psi", 936 }, { "Rho", 929 },
+            { "Scaron", 352 }, { "Sigma", 931 }, { "THORN", 222 }, { "Tau", 932 }, { "Theta", 920 },
+            { "Uacute", 218 }, { "Ucirc", 219 }, { "Ugrave", 217 }, { "Upsilon", 933 },
+            { "Uuml", 220 }, { "Xi", 926 }, { "Yacute", 221 }, { "Yuml", 376 }, { "Zeta", 918 },
+            { "aacute", 225 }, { "acirc", 226 }, { "acute", 180 }, { "aelig", 230 },
+            { "agrave", 224 }, { "alefsym", 8501 }, { "alpha", 945 }, { "amp", 38 },
+            { "and", 8743 }, { "ang", 8736 }, { "aring", 229 }, { "asymp", 8776 },
+            { "atilde", 227 }, { "auml", 228 }, { "bdquo", 8222 }, { "beta", 946 },
+            { "brvbar", 166 }, { "bull", 8226 }, { "cap", 8745 }, { "ccedil", 231 },
+            { "cedil", 184 }, { "cent", 162 }, { "chi", 967 }, { "circ", 710 }, { "clubs", 9827 },
+            { "cong", 8773 }, { "copy", 169 }, { "crarr", 8629 }, { "cup", 8746 },
+            { "curren", 164 }, { "dArr", 8659 }, { "dagger", 8224 }, { "darr", 8595 },
+            { "deg", 176 }, { "delta", 948 }, { "diams", 9830 }, { "divide", 247 },
+            { "eacute", 233 }, { "ecirc", 234 }, { "egrave", 232 }, { "empty", 8709 },
+            { "emsp", 8195 }, { "ensp", 8194 }, { "epsilon", 949 }, { "equiv", 8801 },
+            { "eta", 951 }, { "eth", 240 }, { "euml", 235 }, { "euro", 8364 }, { "exist", 8707 },
+            { "fnof", 402 }, { "forall", 8704 }, { "frac12", 189 }, { "frac14", 188 },
+            { "frac34", 190 }, { "frasl", 8260 }, { "gamma", 947 }, { "ge", 8805 }, { "gt", 62 },
+            { "hArr", 8660 }, { "harr", 8596 }, { "hearts", 9829 }, { "hellip", 8230 },
+            { "iacute", 237 }, { "icirc", 238 }, { "iexcl", 161 }, { "igrave", 236 },
+            { "image", 8465 }, { "infin", 8734 }, { "int", 8747 }, { "iota", 953 },
+            { "iquest", 191 }, { "isin", 8712 }, { "iuml", 239 }, { "kappa", 954 },
+            { "lArr", 8656 }, { "lambda", 955 }, { "lang", 9001 }, { "laquo", 171 },
+            { "larr", 8592 }, { "lceil", 8968 }, { "ldquo", 8220 }, { "le", 8804 },
+            { "lfloor", 8970 }, { "lowast", 8727 }, { "loz", 9674 }, { "lrm", 8206 },
+            { "lsaquo", 8249 }, { "lsquo", 8216 }, { "lt", 60 }, { "macr", 175 }, { "mdash", 8212 },
+            { "micro", 181 }, { "middot", 183 }, { "minus", 8722 }, { "mu", 956 },
+            { "nabla", 8711 }, { "nbsp", 160 }, { "ndash", 8211 }, { "ne", 8800 }, { "ni", 8715 },
+            { "not", 172 }, { "notin", 8713 }, { "nsub", 8836 }, { "ntilde", 241 }, { "nu", 957 },
+            { "oacute", 243 }, { "ocirc", 244 }, { "oelig", 339 }, { "ograve", 242 },
+            { "oline", 8254 }, { "omega", 969 }, { "omicron", 959 }, { "oplus", 8853 },
+            { "or", 8744 }, { "ordf", 170 }, { "ordm", 186 }, { "oslash", 248 }, { "otilde", 245 },
+            { "otimes", 8855 }, { "ouml", 246 }, { "para", 182 }, { "part", 8706 },
+            { "permil", 8240 }, { "perp", 8869 }, { "phi", 966 }, { "pi", 960 }, { "piv", 982 },
+            { "plusmn", 177 }, { "pound", 163 }, { "prime", 8242 }, { "prod", 8719 },
+            { "prop", 8733 }, { "psi", 968 }, { "quot", 34 }, { "rArr", 8658 }, { "radic", 8730 },
+            { "rang", 9002 }, { "raquo", 187 }, { "rarr", 8594 }, { "rceil", 8969 },
+            { "rdquo", 8221 }, { "real", 8476 }, { "reg", 174 }, { "rfloor", 8971 }, { "rho", 961 },
+            { "rlm", 8207 }, { "rsaquo", 8250 }, { "rsquo", 8217 }, { "sbquo", 8218 },
+            { "scaron", 353 }, { "sdot", 8901 }, { "sect", 167 }, { "shy", 173 }, { "sigma", 963 },
+            { "sigmaf", 962 }, { "sim", 8764 }, { "spades", 9824 }, { "sub", 8834 },
+            { "sube", 8838 }, { "sum", 8721 }, { "sup", 8835 }, { "sup1", 185 }, { "sup2", 178 },
+            { "sup3", 179 }, { "supe", 8839 }, { "szlig", 223 }, { "tau", 964 }, { "there4", 8756 },
+            { "theta", 952 }, { "thetasym", 977 }, { "thinsp", 8201 }, { "thorn", 254 },
+            { "tilde", 732 }, { "times", 215 }, { "trade", 8482 }, { "uArr", 8657 },
+            { "uacute", 250 }, { "uarr", 8593 }, { "ucirc", 251 }, { "ugrave", 249 },
+            { "uml", 168 }, { "upsih", 978 }, { "upsilon", 965 }, { "uuml", 252 },
+            { "weierp", 8472 }, { "xi", 958 }, { "yacute", 253 }, { "yen", 165 }, { "yuml", 255 },
+            { "zeta", 950 }, { "zwj", 8205 }, { "zwnj", 8204 },
+        };
+
+        // Names are sorted, entries are appended in order
+        XmlEntityTable table;
+        const size_t n = sizeof html4 / sizeof html4[0];
+        table.entries.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            char utf8[4];
+            table.entries.push_back(Entry(html4[i].name,
+                                          std::string(utf8, xml_encode_utf8(html4[i].code, utf8))));
+        }
+        return table;
+    }
+
+    inline bool XmlReference::match(Parser<char> * parser, Storage<void> &) const
+    {
+        ELL_BEGIN_PARSE
+        const char * begin = parser->position;
+        if (* begin == '&')
+        {
+            // Entity names longer than that are not worth looking up
+            const char * name = begin + 1, * end = name;
+            while (* end && * end != ';' && end - name < 32)
+                ++end;
+            if (* end != ';')
+                parser->raise_error("Malformed reference");
+            size_t size = end - name;
+
+            char buffer[4];
+            const char * text = buffer;
+            size_t n = 1;
+
+            if (size && * name == '#')
+            {
+                // Character reference
+                bool hex = size > 1 && (name[1] == 'x' || name[1] == 'X');
+                const char * d = name + (hex ? 2 : 1);
+                uint32_t code = 0;
+                if (d == end)
+                    code = 0x110000;
+                for (; d < end && code <= 0x10FFFF; ++d)
+                {
+                    if (* d >= '0' && * d <= '9')
+                        code = code * (hex ? 16 : 10) + (* d - '0');
+                    else if (hex && ((* d | 0x20) >= 'a' && (* d | 0x20) <= 'f'))
+                        code = code * 16 + ((* d | 0x20) - 'a' + 10);
+                    else
+                        code = 0x110000;
+                }
+                if (code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+                    parser->raise_error("Invalid character reference `" + std::string(begin, end + 1) + "`");
+                n = xml_encode_utf8(code, buffer);
+            }
+            else
+            {
+                // Predefined entities first, dispatched on the name size
+                switch (size)
+                {
+                case 2:
+                    if (name[1] == 't' && (name[0] == 'l' || name[0] == 'g'))
+                        buffer[0] = name[0] == 'l' ? '<' : '>';
+                    else
+                        n = 0;
+                    break;
+                case 3:
+                    if (! memcmp(name, "amp", 3))
+                        buffer[0] = '&';
+                    else
+                        n = 0;
+                    break;
+                case 4:
+                    if (! memcmp(name, "quot", 4))
+                        buffer[0] = '\"';
+                    else if (! memcmp(name, "apos", 4))
+                        buffer[0] = '\'';
+                    else
+                        n = 0;
+                    break;
+                default:
+                    n = 0;
+                }
+
+                if (! n)
+                {
+                    const XmlEntityTable * entities = static_cast<XmlParser *>(parser)->entities;
+                    const std::string * value = entities ? entities->find(name, size) : 0;
+                    if (! value)
+                        parser->raise_error("Unknown entity `" + std::string(name, size) + "`");
+                    text = value->data();
+                    n = value->size();
+                }
+            }
+
+            static_cast<XmlParser *>(parser)->push_reference(begin, end + 1, text, n);
+            parser->position = end + 1;
+            match = true;
+        }
+        ELL_END_PARSE
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLENTITIES_H
@@ -0,0 +1,333 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLFROZEN_H
+#define INCLUDED_ELL_IMPL_XMLFROZEN_H
+
+namespace ell
+{
+    inline XmlFrozenRef::XmlFrozenRef(const XmlFrozenNode * node)
+      : node(node)
+    {
+        if (node)
+            node->retain();
+    }
+
+    inline XmlFrozenRef::XmlFrozenRef(const XmlFrozenRef & other)
+      : node(other.node)
+    {
+        if (node)
+            node->retain();
+    }
+
+    inline XmlFrozenRef::~XmlFrozenRef()
+    {
+        if (node)
+            node->release();
+    }
+
+    inline XmlFrozenRef & XmlFrozenRef::operator = (const XmlFrozenRef & other)
+    {
+        if (other.node)
+            other.node->retain();
+        if (node)
+            node->release();
+        node = other.node;
+        return * this;
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::element(const std::string & name, const Attributes & attributes,
+                                               const Children & children, int line)
+    {
+        assert(! name.empty());
+        return XmlFrozenRef(new XmlFrozenNode(name, std::string(), attributes, children, line));
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::data_node(const std::string & data, int line)
+    {
+        return XmlFrozenRef(new XmlFrozenNode(std::string(), data, Attributes(), Children(), line));
+    }
+
+    inline const std::string & XmlFrozenNode::get_attrib(const ell::string & attr_name) const
+    {
+        for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+        {
+            if (attr_name == i->first)
+                return i->second;
+        }
+        raise_error(describe() + ": no such attribute: " + attr_name);
+        return data;
+    }
+
+    template <typename T>
+    T XmlFrozenNode::get_attrib(const ell::string & attr_name) const
+    {
+        T value;
+        if (! xml_convert(get_attrib(attr_name), value))
+            raise_error("Wrong type for attribute " + attr_name);
+        return value;
+    }
+
+    template <>
+    inline std::string XmlFrozenNode::get_attrib<std::string>(const ell::string & attr_name) const
+    {
+        return get_attrib(attr_name);
+    }
+
+    inline bool XmlFrozenNode::has_attrib(const ell::string & attr_name) const
+    {
+        for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+        {
+            if (attr_name == i->first)
+                return true;
+        }
+        return false;
+    }
+
+    inline const XmlFrozenNode * XmlFrozenNode::child_at(size_t i) const
+    {
+        if (i >= children.size())
+            raise_error(describe() + ": no such child");
+        return children[i].get();
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::with_attrib(const ell::string & attr_name, const std::string & value) const
+    {
+        assert(is_element());
+        Attributes a(attributes);
+        Attributes::iterator i = a.begin();
+        while (i != a.end() && ! (attr_name == i->first))
+            ++i;
+        if (i == a.end())
+            a.push_back(std::make_pair(attr_name.str(), value));
+        else
+            i->second = value;
+        return XmlFrozenRef(new XmlFrozenNode(name, data, a, children, line));
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::without_attrib(const ell::string & attr_name) const
+    {
+        Attributes a;
+        for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+        {
+            if (! (attr_name == i->first))
+                a.push_back(* i);
+        }
+        return XmlFrozenRef(new XmlFrozenNode(name, data, a, children, line));
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::with_children(const Children & c) const
+    {
+        assert(is_element() || c.empty());
+        return XmlFrozenRef(new XmlFrozenNode(name, data, attributes, c, line));
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::update(const size_t * path, size_t n, const XmlFrozenRef & node, bool insert) const
+    {
+        size_t i = path[0];
+        if (i > children.size() || (i == children.size() && ! (insert && n == 1)))
+            raise_error(describe() + ": no such child");
+
+        Children c(children);
+        if (n > 1)
+            c[i] = c[i]->update(path + 1, n - 1, node, insert);
+        else if (insert)
+            c.insert(c.begin() + i, node);
+        else if (node)
+            c[i] = node;
+        else
+            c.erase(c.begin() + i);
+        return with_children(c);
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::replace(const std::vector<size_t> & path, const XmlFrozenRef & node) const
+    {
+        if (path.empty())
+            return node;
+        return update(& path[0], path.size(), node, false);
+    }
+
+    inline XmlFrozenRef XmlFrozenNode::insert(const std::vector<size_t> & path, const XmlFrozenRef & node) const
+    {
+        assert(node);
+        if (path.empty())
+            raise_error(describe() + ": cannot insert a sibling of the root");
+        return update(& path[0], path.size(), node, true);
+    }
+
+    inline XmlNode * XmlFrozenNode::thaw(XmlNameTable & names) const
+    {
+        XmlNode * n = new XmlNode(0, line);
+        if (is_data())
+            return n->set_data(data);
+
+        try
+        {
+            // Attributes are interned in the table of the node name
+            n->name = names.intern(name);
+            for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+                n->set_attrib(i->first, i->second);
+            for (Children::const_iterator i = children.begin(); i != children.end(); ++i)
+                n->enqueue_child((* i)->thaw(names));
+        }
+        catch (...)
+        {
+            delete n;
+            throw;
+        }
+        return n;
+    }
+
+    inline void XmlFrozenNode::unparse(std::ostream & os, int indent, int shift) const
+    {
+        XmlStreamOutput out(os);
+        XmlSerializer serializer(out);
+        write_pretty(serializer, indent, shift);
+    }
+
+    inline void XmlFrozenNode::write_pretty(XmlSerializer & serializer, int indent, int shift) const
+    {
+        XmlOutput & out = serializer.out;
+        if (is_data())
+        {
+            serializer.write_text(data.data(), data.size(), true);
+            out.put('\n');
+            return;
+        }
+
+        serializer.write_indent(indent * shift);
+        out.put('<');
+        out.write(name);
+        for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+        {
+            out.put(' ');
+            out.write(i->first);
+            out.write("=\"", 2);
+            serializer.write_attribute_value(i->second.data(), i->second.size(), true);
+            out.put('\"');
+        }
+
+        if (children.empty())
+        {
+            out.write(" />\n", 4);
+            return;
+        }
+
+        out.write(">\n", 2);
+        for (Children::const_iterator i = children.begin(); i != children.end(); ++i)
+            (* i)->write_pretty(serializer, indent + 1, shift);
+        serializer.write_indent(indent * shift);
+        out.write("</", 2);
+        out.write(name);
+        out.write(">\n", 2);
+    }
+
+    inline std::string XmlFrozenNode::describe() const
+    {
+        std::ostringstream oss;
+        if (line)
+            oss << line << ": ";
+        if (is_element())
+        {
+            oss << "Element `" << name << "`";
+            for (Attributes::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+                oss << " " << i->first << "=" << i->second;
+        }
+        else
+            oss << "Data \"" + protect(data) + "\"";
+        return oss.str();
+    }
+
+    inline void XmlFrozenNode::raise_error(const std::string & msg) const
+    {
+        std::ostringstream oss;
+        if (line)
+            oss << line << ": ";
+        oss << msg << std::endl;
+        throw std::runtime_error(oss.str());
+    }
+
+    inline XmlFrozenRef xml_freeze(const XmlNode * node)
+    {
+        if (node->is_data())
+            return XmlFrozenNode::data_node(node->data, node->line);
+
+        XmlFrozenNode::Attributes attributes;
+        attributes.reserve(node->attributes.size());
+        for (XmlAttributesMap::const_iterator i = node->attributes.begin(); i != node->attributes.end(); ++i)
+            attributes.push_back(std::make_pair(i->first.str(), i->second));
+
+        XmlFrozenNode::Children children;
+        for (const XmlNode * c = node->_first_child; c; c = c->_next_sibling)
+            children.push_back(xml_freeze(c));
+
+        return XmlFrozenNode::element(node->get_name(), attributes, children, node->line);
+    }
+
+    inline XmlFrozenDocument::XmlFrozenDocument(const XmlFrozenRef & root)
+      : current(root.get()), pending(0)
+    {
+        if (root)
+            root->retain();
+    }
+
+    inline XmlFrozenDocument::~XmlFrozenDocument()
+    {
+        const XmlFrozenNode * n = current.load();
+        if (n)
+            n->release();
+        for (size_t i = 0; i < retired.size(); ++i)
+            retired[i]->release();
+    }
+
+    inline XmlFrozenRef XmlFrozenDocument::acquire() const
+    {
+        // A writer does not drop a replaced version while a reader may have
+        // loaded it without holding a reference yet
+        pending.fetch_add(1);
+        XmlFrozenRef r(current.load());
+        pending.fetch_sub(1);
+        return r;
+    }
+
+    inline void XmlFrozenDocument::publish(const XmlFrozenRef & root)
+    {
+        std::lock_guard<std::mutex> lock(writers);
+        if (root)
+            root->retain();
+        const XmlFrozenNode * old = current.exchange(root.get());
+        if (old)
+            retired.push_back(old);
+        collect_locked();
+    }
+
+    inline void XmlFrozenDocument::collect()
+    {
+        std::lock_guard<std::mutex> lock(writers);
+        collect_locked();
+    }
+
+    inline void XmlFrozenDocument::collect_locked()
+    {
+        // Readers entering acquire() from now on load a newer version
+        if (pending.load() != 0)
+            return;
+        for (size_t i = 0; i < retired.size(); ++i)
+            retired[i]->release();
+        retired.clear();
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLFROZEN_H
@@ -0,0 +1,172 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLNAME_H
+#define INCLUDED_ELL_IMPL_XMLNAME_H
+
+namespace ell
+{
+    inline XmlName::XmlName(const ell::string & s)
+      : entry(XmlNameTable::default_table().intern(s).entry)
+    { }
+
+    inline XmlName & XmlName::operator = (const ell::string & s)
+    {
+        XmlNameTable * t = table();
+        entry = (t ? * t : XmlNameTable::default_table()).intern(s).entry;
+        return * this;
+    }
+
+    inline const std::string & XmlName::str() const
+    {
+        static const std::string empty;
+        return entry ? entry->str : empty;
+    }
+
+    inline uint32_t XmlNameTable::hash(const ell::string & s)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (const char * p = s.position, * end = s.position + s.size(); p != end; ++p)
+            h = (h ^ (unsigned char) * p) * 16777619u;
+        return h;
+    }
+
+    inline size_t XmlNameTable::lookup(const ell::string & s, uint32_t h) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i] && ! (s == entries[slots[i] - 1].str))
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    inline XmlName XmlNameTable::find(const ell::string & s) const
+    {
+        if (s.size() == 0)
+            return XmlName();
+        Lock lock(* this);
+        return entry(slots[lookup(s, hash(s))]);
+    }
+
+    inline XmlName XmlNameTable::intern(const ell::string & s)
+    {
+        if (s.size() == 0)
+            return XmlName();
+        Lock lock(* this);
+        return add(s);
+    }
+
+    inline XmlName XmlNameTable::add(const ell::string & s)
+    {
+        if (s.size() == 0)
+            return XmlName();
+
+        uint32_t h = hash(s);
+        size_t i = lookup(s, h);
+        if (! slots[i])
+        {
+            if (2 * (entries.size() + 1) > slots.size())
+            {
+                grow();
+                i = lookup(s, h);
+            }
+
+            XmlName::Entry e;
+            e.str.assign(s.position, s.size());
+            e.id = (uint32_t) entries.size() + 1;
+            e.table = this;
+            e.prefix = 0;
+            entries.push_back(e);
+            slots[i] = e.id;
+
+            XmlName::Entry & added = entries.back();
+            added.local = & added;
+            size_t colon = added.str.find(':');
+            if (colon != std::string::npos && colon != 0 && colon + 1 != added.str.size())
+            {
+                // Entries never move, while slots may be grown by these calls
+                uint32_t id = e.id;
+                added.prefix = add(ell::string(s.position, colon)).entry;
+                added.local = add(ell::string(s.position + colon + 1, s.size() - colon - 1)).entry;
+                return entry(id);
+            }
+        }
+        return entry(slots[i]);
+    }
+
+    inline void XmlNameTable::grow()
+    {
+        std::vector<uint32_t> old(slots.size() * 2, 0);
+        old.swap(slots);
+
+        for (std::vector<uint32_t>::const_iterator i = old.begin(); i != old.end(); ++i)
+        {
+            if (* i)
+            {
+                const std::string & str = entries[* i - 1].str;
+                slots[lookup(ell::string(str), hash(ell::string(str)))] = * i;
+            }
+        }
+    }
+
+    inline XmlName XmlNameMap::operator () (const XmlName & name)
+    {
+        if (! to || name.empty() || name.table() == to)
+            return name;
+
+        if (name.table() != from)
+        {
+            from = name.table();
+            cache.clear();
+        }
+        if (name.id() >= cache.size())
+            cache.resize(std::max((size_t) name.id() + 1, from->size() + 1));
+
+        XmlName & n = cache[name.id()];
+        if (n.empty())
+            n = to->intern(ell::string(name.str()));
+        return n;
+    }
+
+    inline XmlNamespaces * XmlNameMap::operator () (XmlNamespaces * scope)
+    {
+        if (! to || ! scope)
+            return scope;
+
+        bool same = true;
+        for (size_t i = 0; i < scope->bindings.size(); ++i)
+        {
+            same = same && (scope->bindings[i].first.empty() || scope->bindings[i].first.table() == to) &&
+                           (scope->bindings[i].second.empty() || scope->bindings[i].second.table() == to);
+        }
+        if (same)
+            return scope;
+
+        for (size_t i = 0; i < scopes.size(); ++i)
+        {
+            if (scopes[i].first == scope)
+                return scopes[i].second;
+        }
+
+        XmlNamespaces * s = new XmlNamespaces;
+        for (size_t i = 0; i < scope->bindings.size(); ++i)
+            s->bind((* this)(scope->bindings[i].first), (* this)(scope->bindings[i].second));
+        scopes.push_back(std::make_pair(scope, s));
+        return s;
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLNAME_H
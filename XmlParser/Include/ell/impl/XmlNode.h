@@ -18,16 +18,17 @@
 
 namespace ell
 {
-    inline XmlNode * XmlNode::remove_attrib(const std::string & attr_name)
+    inline XmlNode * XmlNode::remove_attrib(const ell::string & attr_name)
     {
         XmlAttributesMap::iterator i = attributes.find(attr_name);
         if (i == attributes.end())
             raise_error(describe() + ": no such attribute: " + attr_name);
         attributes.erase(i);
+        invalidate_hash();
         return this;
     }
 
-    inline const std::string XmlNode::get_attrib(const std::string & attr_name) const
+    inline const std::string & XmlNode::get_attrib(const ell::string & attr_name) const
     {
         assert(is_element());
         XmlAttributesMap::const_iterator i = attributes.find(attr_name);
@@ -36,21 +37,58 @@ namespace ell
         return i->second;
     }
 
-    inline XmlNode * XmlNode::set_attrib(const std::string & attr_name, const std::string & value)
+    inline XmlNode * XmlNode::get_attribs(XmlAttributeRequest * requests, size_t n)
     {
         assert(is_element());
-        attributes[attr_name] = value;
+        for (size_t k = 0; k < n; ++k)
+            requests[k].found = false;
+
+        size_t found = 0;
+        for (XmlAttributesMap::const_iterator i = attributes.begin(); i != attributes.end() && found < n; ++i)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                XmlAttributeRequest & r = requests[k];
+                if (r.found || i->first.size() != r.size || memcmp(i->first.str().data(), r.name, r.size))
+                    continue;
+
+                const std::string & value = i->second;
+                if (! r.convert(value.data(), value.data() + value.size(), r.value))
+                    raise_error(std::string("Wrong type for attribute ") + r.name);
+                r.found = true;
+                ++found;
+                break;
+            }
+        }
+
+        for (size_t k = 0; k < n; ++k)
+        {
+            if (requests[k].required && ! requests[k].found)
+                raise_error(describe() + ": no such attribute: " + requests[k].name);
+        }
         return this;
     }
 
-    inline bool XmlNode::has_attrib(const std::string & attr_name) const
+    inline XmlNode * XmlNode::set_attrib(const ell::string & attr_name, const std::string & value)
+    {
+        assert(is_element());
+        XmlAttributesMap::iterator i = attributes.find(attr_name);
+        if (i == attributes.end())
+            attributes.push_back(name_table().intern(attr_name), value);
+        else
+            i->second = value;
+        invalidate_hash();
+        return this;
+    }
+
+    inline bool XmlNode::has_attrib(const ell::string & attr_name) const
     {
         assert(is_element());
         XmlAttributesMap::const_iterator i = attributes.find(attr_name);
         return i != attributes.end();
     }
 
-    inline XmlNode * XmlNode::check_attrib(const std::string & attr_name, const std::string & value)
+    inline XmlNode * XmlNode::check_attrib(const ell::string & attr_name, const ell::string & value)
     {
         const std::string & val = get_attrib(attr_name);
         if (val != value)
@@ -60,7 +98,7 @@ namespace ell
         return this;
     }
 
-    inline XmlNode * XmlNode::check_attrib_present(const std::string & attr_name)
+    inline XmlNode * XmlNode::check_attrib_present(const ell::string & attr_name)
     {
         get_attrib(attr_name);
         return this;
@@ -69,7 +107,7 @@ namespace ell
     inline const std::string & XmlNode::get_name() const
     {
         assert(is_element());
-        return name;
+        return name.str();
     }
 
     inline XmlNode * XmlNode::get_name(std::string & n)
@@ -81,7 +119,8 @@ namespace ell
     inline XmlNode * XmlNode::set_name(const std::string & n)
     {
         assert(data.empty());
-        name = n;
+        name = ell::string(n);
+        invalidate_hash();
         return this;
     }
 
@@ -92,6 +131,14 @@ namespace ell
         return this;
     }
 
+    inline XmlNode * XmlNode::check_name(const XmlName & n)
+    {
+        assert(is_element());
+        if (n != name)
+            raise_error(describe() + ": expecting element " + n.str());
+        return this;
+    }
+
     inline const std::string & XmlNode::get_data() const
     {
         assert(is_data());
@@ -102,6 +149,7 @@ namespace ell
     {
         assert(is_data());
         data = d;
+        invalidate_hash();
         return this;
     }
 
@@ -126,39 +174,8 @@ namespace ell
 
     inline void XmlNode::unparse(std::ostream & out, int indent, int shift) const
     {
-        if (is_data())
-        {
-            out << XmlGrammar::protect(data) << '\n';
-        }
-        else
-        {
-            std::string indent_str(indent * shift, ' ');
-            out << indent_str << '<' << name;
-
-            for (XmlAttributesMap::const_iterator i=attributes.begin();
-                i != attributes.end();
-                ++i)
-            {
-                out << ' ' << i->first << "=\"" << XmlGrammar::protect(i->second) << "\"";
-            }
-
-            if (! _first_child)
-            {
-                out << " />\n";
-            }
-            else
-            {
-                out << ">\n";
-                for (XmlNode * p = _first_child;
-                    p;
-                    p = p->_next_sibling)
-                {
-                    p->unparse(out, indent + 1, shift);
-                }
-
-                out << indent_str << "</" << name << ">\n";
-            }
-        }
+        XmlStreamOutput o(out);
+        XmlSerializer(o).write_pretty(* this, indent, shift);
     }
 
     inline XmlNode * XmlNode::next_sibling() const
@@ -198,6 +215,8 @@ namespace ell
 
     inline XmlNode * XmlNode::insert_sibling_node_before(XmlNode * p)
     {
+        _parent->invalidate_hash();
+        _parent->drop_child_index();
         p->_next_sibling=this;
         p->_previous_sibling=_previous_sibling;
         p->_parent=_parent;
@@ -211,6 +230,8 @@ namespace ell
 
     inline XmlNode * XmlNode::insert_sibling_node_after(XmlNode * p)
     {
+        _parent->invalidate_hash();
+        _parent->drop_child_index();
         p->_previous_sibling=this;
         p->_next_sibling=_next_sibling;
         p->_parent=_parent;
@@ -224,6 +245,7 @@ namespace ell
 
     inline XmlNode * XmlNode::enqueue_child(XmlNode * p)
     {
+        invalidate_hash();
         if (_last_child)
             _last_child->_next_sibling=p;
         else
@@ -231,11 +253,22 @@ namespace ell
         p->_previous_sibling=_last_child;
         _last_child=p;
         p->_parent=this;
+        if (child_index)
+        {
+            p->sibling_index = child_index->size();
+            child_index->push_back(p);
+        }
         return p;
     }
 
     inline XmlNode * XmlNode::detach()
     {
+        if (_parent)
+        {
+            _parent->invalidate_hash();
+            _parent->drop_child_index();
+        }
+
         if (_previous_sibling)
         {
             _previous_sibling->_next_sibling = _next_sibling;
@@ -259,6 +292,127 @@ namespace ell
         return this;
     }
 
+    inline bool XmlNode::is_named(const XmlName & uri, const XmlName & local) const
+    {
+        return ! name.empty() && name.local() == local && ns == uri;
+    }
+
+    inline XmlName XmlNode::attrib_namespace(const XmlName & attr_name) const
+    {
+        XmlName prefix = attr_name.prefix(), uri;
+        if (prefix.empty())
+            return uri;
+        if (! namespaces || ! namespaces->resolve(prefix, uri))
+            raise_error(describe() + ": undeclared namespace prefix " + prefix.str());
+        return uri;
+    }
+
+    inline XmlAttributesMap::const_iterator XmlNode::find_attrib_ns(const XmlName & uri, const XmlName & local) const
+    {
+        XmlAttributesMap::const_iterator i = attributes.begin();
+        while (i != attributes.end() && ! (i->first.local() == local && attrib_namespace(i->first) == uri))
+            ++i;
+        return i;
+    }
+
+    inline const std::string & XmlNode::get_attrib_ns(const XmlName & uri, const XmlName & local) const
+    {
+        XmlAttributesMap::const_iterator i = find_attrib_ns(uri, local);
+        if (i == attributes.end())
+            raise_error(describe() + ": no such attribute: {" + uri.str() + "}" + local.str());
+        return i->second;
+    }
+
+    inline bool XmlNode::has_attrib_ns(const XmlName & uri, const XmlName & local) const
+    {
+        return find_attrib_ns(uri, local) != attributes.end();
+    }
+
+    inline void XmlNode::set_namespaces(XmlNamespaces * scope)
+    {
+        if (scope)
+            scope->retain();
+        if (namespaces)
+            namespaces->release();
+        namespaces = scope;
+    }
+
+    inline XmlNode * XmlNode::clone(Parser<char> * p, XmlNameTable * names) const
+    {
+        XmlNameMap map(names);
+        return clone(p ? p : parser, map);
+    }
+
+    inline XmlNode * XmlNode::clone(Parser<char> * p, XmlNameMap & names) const
+    {
+        XmlNode * n = new XmlNode(p, line);
+        try
+        {
+            n->name = names(name);
+            n->ns = names(ns);
+            n->set_namespaces(names(namespaces));
+            n->data = data;
+            n->attributes.reserve(attributes.size());
+            for (XmlAttributesMap::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+                n->attributes.push_back(names(i->first), i->second);
+
+            // Children are linked directly: there is no hash nor index to update yet
+            for (const XmlNode * c = _first_child; c; c = c->_next_sibling)
+            {
+                XmlNode * k = c->clone(p, names);
+                k->_parent = n;
+                k->_previous_sibling = n->_last_child;
+                if (n->_last_child)
+                    n->_last_child->_next_sibling = k;
+                else
+                    n->_first_child = k;
+                n->_last_child = k;
+            }
+        }
+        catch (...)
+        {
+            delete n;
+            throw;
+        }
+
+        // Hashes do not depend on name tables
+        n->hash_cache = hash_cache;
+        return n;
+    }
+
+    inline XmlNode * XmlNode::transfer(Parser<char> * p, XmlNameTable & names)
+    {
+        detach();
+        XmlNameMap map(& names);
+        rebind(p, map);
+        return this;
+    }
+
+    inline void XmlNode::rebind(Parser<char> * p, XmlNameMap & names)
+    {
+        parser = p;
+        source_begin = source_end = 0;
+        name = names(name);
+        ns = names(ns);
+        set_namespaces(names(namespaces));
+        for (XmlAttributesMap::iterator i = attributes.begin(); i != attributes.end(); ++i)
+            i->first = names(i->first);
+        for (XmlNode * c = _first_child; c; c = c->_next_sibling)
+            c->rebind(p, names);
+    }
+
+    inline void XmlNode::raise_error(const std::string & msg) const
+    {
+        if (parser)
+            parser->raise_error(msg, line);
+
+        std::ostringstream oss;
+        if (line)
+            oss << line << ": ";
+        oss << msg << std::endl;
+        throw std::runtime_error(oss.str());
+    }
+
     inline void XmlNode::delete_children()
     {
         XmlNode * sav_p, * p;
@@ -267,6 +421,66 @@ namespace ell
             sav_p=p->_next_sibling;
             delete p;
         }
+        _first_child = _last_child = 0;
+        invalidate_hash();
+        drop_child_index();
+    }
+
+    inline void XmlNode::build_child_index() const
+    {
+        // Leaves have no array
+        if (child_index || ! _first_child)
+            return;
+        child_index = new std::vector<XmlNode *>;
+        for (XmlNode * p = _first_child; p; p = p->_next_sibling)
+        {
+            p->sibling_index = child_index->size();
+            child_index->push_back(p);
+        }
+    }
+
+    inline void XmlNode::drop_child_index()
+    {
+        delete child_index;
+        child_index = 0;
+    }
+
+    inline void XmlNode::build_index(bool deep) const
+    {
+        build_child_index();
+        if (deep)
+        {
+            for (const XmlNode * p = _first_child; p; p = p->_next_sibling)
+                p->build_index(true);
+        }
+    }
+
+    inline size_t XmlNode::child_count() const
+    {
+        build_child_index();
+        return child_index ? child_index->size() : 0;
+    }
+
+    inline XmlNode * XmlNode::child_at(size_t i) const
+    {
+        build_child_index();
+        if (! child_index || i >= child_index->size())
+            raise_error(describe() + ": no such child");
+        return (* child_index)[i];
+    }
+
+    inline size_t XmlNode::index_in_parent() const
+    {
+        parent()->build_child_index();
+        return sibling_index;
+    }
+
+    inline XmlNodeRange XmlNode::children() const
+    {
+        build_child_index();
+        if (! child_index)
+            return XmlNodeRange();
+        return XmlNodeRange(& child_index->front(), & child_index->front() + child_index->size());
     }
 
     inline std::string XmlNode::describe() const
@@ -277,7 +491,7 @@ namespace ell
         if (is_element())
         {
             oss << "Element `" << name << "`";
-            for (XmlAttributesMap::const_iterator io, i = attributes.begin();
+            for (XmlAttributesMap::const_iterator i = attributes.begin();
                 i != attributes.end();
                 ++i)
             {
@@ -289,8 +503,40 @@ namespace ell
         return oss.str();
     }
 
+    inline uint64_t XmlNode::hash() const
+    {
+        if (hash_cache)
+            return hash_cache;
+
+        uint64_t h = xml_hash(data.data(), data.size(), xml_hash(name.str().data(), name.size()));
+
+        // Attributes are summed, so that their order does not matter
+        // Names and values are hashed apart, so that `ab="c"` differs from `a="bc"`.
+        uint64_t a = 0;
+        for (XmlAttributesMap::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+            a += xml_mix(xml_hash(i->first.str().data(), i->first.size()) * 31 ^
+                         xml_hash(i->second.data(), i->second.size()));
+        h = xml_mix(h ^ xml_mix(a));
+
+        for (XmlNode * child = _first_child; child; child = child->_next_sibling)
+            h = xml_mix(h * 31 + child->hash());
+
+        hash_cache = h ? h : 1;
+        return hash_cache;
+    }
+
+    inline void XmlNode::invalidate_hash()
+    {
+        for (XmlNode * p = this; p && p->hash_cache; p = p->_parent)
+            p->hash_cache = 0;
+    }
+
     inline bool XmlNode::is_equal(const XmlNode & other) const
     {
+        // Hashes are only compared when already known
+        if (hash_cache && other.hash_cache && hash_cache != other.hash_cache)
+            return false;
+
         if (name != other.name ||
             data != other.data ||
             attributes.size() != other.attributes.size())
@@ -366,18 +612,27 @@ namespace ell
 
     inline XmlIterator XmlIterator::operator + (int inc) const
     {
+        const XmlNode * parent = current ? current->_parent : 0;
+        if (parent && parent->child_index)
+        {
+            // Through the children array of the parent, never built here
+            long i = (long) current->sibling_index + inc;
+            if (i < 0 || i >= (long) parent->child_index->size())
+                return XmlIterator();
+            return XmlIterator((* parent->child_index)[i]);
+        }
+
         XmlIterator it(*this);
-        for (int i = 0; i < inc; i++)
+        for (; inc > 0 && it; --inc)
             ++it;
+        for (; inc < 0 && it; ++inc)
+            --it;
         return it;
     }
 
     inline XmlIterator XmlIterator::operator - (int dec) const
     {
-        XmlIterator it(*this);
-        for (int i = 0; i < dec; i++)
-            --it;
-        return it;
+        return * this + (- dec);
     }
 }
 
@@ -0,0 +1,192 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLPARALLEL_H
+#define INCLUDED_ELL_IMPL_XMLPARALLEL_H
+
+namespace ell
+{
+    /// Subtree sizes, in document order
+    inline size_t xml_subtree_sizes(const XmlNode * node, std::vector<size_t> & sizes)
+    {
+        size_t i = sizes.size();
+        sizes.push_back(1);
+        for (const XmlNode * c = node->_first_child; c; c = c->_next_sibling)
+            sizes[i] += xml_subtree_sizes(c, sizes);
+        return sizes[i];
+    }
+
+    /// Cut the walk of a node bigger than the threshold, whose ordinal is the given one
+    inline void xml_split(const XmlNode * node, size_t ordinal, size_t threshold, const std::vector<size_t> & sizes,
+                          std::vector<XmlVisitTask> & tasks)
+    {
+        tasks.push_back(XmlVisitTask(XmlVisitTask::ENTER, node));
+
+        // Run of small siblings being packed
+        const XmlNode * first = 0;
+        size_t count = 0, size = 0;
+
+        size_t i = ordinal + 1;
+        for (const XmlNode * c = node->_first_child; c; i += sizes[i], c = c->_next_sibling)
+        {
+            if (first && (sizes[i] > threshold || size + sizes[i] > threshold))
+            {
+                tasks.push_back(XmlVisitTask(XmlVisitTask::SUBTREES, first, count));
+                first = 0;
+            }
+
+            if (sizes[i] > threshold)
+            {
+                xml_split(c, i, threshold, sizes, tasks);
+            }
+            else
+            {
+                if (! first)
+                {
+                    first = c;
+                    count = size = 0;
+                }
+                ++count;
+                size += sizes[i];
+            }
+        }
+        if (first)
+            tasks.push_back(XmlVisitTask(XmlVisitTask::SUBTREES, first, count));
+
+        tasks.push_back(XmlVisitTask(XmlVisitTask::LEAVE, node));
+    }
+
+    inline void xml_partition(const XmlNode * root, size_t threshold, std::vector<XmlVisitTask> & tasks)
+    {
+        std::vector<size_t> sizes;
+        xml_subtree_sizes(root, sizes);
+
+        if (sizes[0] <= threshold)
+            tasks.push_back(XmlVisitTask(XmlVisitTask::SUBTREES, root));
+        else
+            xml_split(root, 0, threshold, sizes, tasks);
+    }
+
+    template <typename Accumulator>
+    Accumulator XmlParallelVisitor<Accumulator>::process(const XmlNode * root)
+    {
+        tasks.clear();
+        xml_partition(root, std::max(threshold, (size_t) 1), tasks);
+        results.assign(tasks.size(), Accumulator());
+
+        size_t n = workers ? workers : std::thread::hardware_concurrency();
+        n = std::max((size_t) 1, std::min(n, tasks.size()));
+
+        // Round robin seeding, then workers balance the load by stealing
+        queues.clear();
+        queues.resize(n);
+        for (size_t i = 0; i < tasks.size(); ++i)
+            queues[i % n].tasks.push_back(i);
+
+        cancelled = false;
+        error = std::exception_ptr();
+
+        std::vector<std::thread> threads;
+        for (size_t w = 1; w < n; ++w)
+            threads.push_back(std::thread(& XmlParallelVisitor::work, this, w));
+        work(0);
+        for (size_t w = 0; w < threads.size(); ++w)
+            threads[w].join();
+
+        if (error)
+            std::rethrow_exception(error);
+
+        Accumulator result = Accumulator();
+        for (size_t i = 0; i < results.size(); ++i)
+            reduce(result, results[i]);
+        return result;
+    }
+
+    template <typename Accumulator>
+    void XmlParallelVisitor<Accumulator>::visit(const XmlNode * node, Accumulator & acc)
+    {
+        enterNode(node, acc);
+        for (const XmlNode * c = node->_first_child; c; c = c->_next_sibling)
+            visit(c, acc);
+        leaveNode(node, acc);
+    }
+
+    template <typename Accumulator>
+    void XmlParallelVisitor<Accumulator>::run(const XmlVisitTask & task, Accumulator & acc)
+    {
+        switch (task.kind)
+        {
+        case XmlVisitTask::SUBTREES:
+        {
+            const XmlNode * n = task.first;
+            for (size_t i = 0; i < task.count; ++i, n = n->_next_sibling)
+                visit(n, acc);
+            break;
+        }
+        case XmlVisitTask::ENTER:
+            enterNode(task.first, acc);
+            break;
+        case XmlVisitTask::LEAVE:
+            leaveNode(task.first, acc);
+            break;
+        }
+    }
+
+    template <typename Accumulator>
+    bool XmlParallelVisitor<Accumulator>::next_task(size_t worker, size_t & task)
+    {
+        // Own tasks are taken from the back, stolen ones from the front
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            Queue & q = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (! q.tasks.empty())
+            {
+                if (i == 0)
+                {
+                    task = q.tasks.back();
+                    q.tasks.pop_back();
+                }
+                else
+                {
+                    task = q.tasks.front();
+                    q.tasks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Accumulator>
+    void XmlParallelVisitor<Accumulator>::work(size_t worker)
+    {
+        try
+        {
+            size_t t;
+            while (! cancelled.load(std::memory_order_relaxed) && next_task(worker, t))
+                run(tasks[t], results[t]);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (! error)
+                error = std::current_exception();
+            cancelled = true;
+        }
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLPARALLEL_H
@@ -21,31 +21,16 @@ namespace ell
     inline std::string XmlGrammar::protect(const std::string & cdata)
     {
         std::string protected_data;
-        size_t pos = 0;
+        protected_data.reserve(cdata.size());
 
-        while (pos < cdata.size())
+        for (const char * s = cdata.data(), * end = s + cdata.size(); ; )
         {
-            size_t r = cdata.find_first_of("\"\'&<>", pos);
-
-            if (r != std::string::npos)
-            {
-                protected_data += cdata.substr(pos, r - pos);
-
-                switch (cdata[r])
-                {
-                case '\"': protected_data += "&quot;"; break;
-                case '\'': protected_data += "&apos;"; break;
-                case '&': protected_data += "&amp;"; break;
-                case '<': protected_data += "&lt;"; break;
-                case '>': protected_data += "&gt;"; break;
-                }
-                pos = r + 1;
-            }
-            else
-            {
-                protected_data += cdata.substr(pos);
+            const char * p = XmlSerializer::find_special(s, end, XmlSerializer::all_specials());
+            protected_data.append(s, p);
+            if (p == end)
                 break;
-            }
+            protected_data += XmlSerializer::entity(* p);
+            s = p + 1;
         }
 
         return protected_data;
@@ -53,10 +38,12 @@ namespace ell
 
     inline XmlGrammar::XmlGrammar()
     {
-        document = + ( element
-                     | comment
-                     | pi
-                     | data ) >> end [& XmlParser::on_end_of_file];
+        document = + item >> end [& XmlParser::on_end_of_file];
+
+        item = element
+             | comment
+             | pi
+             | data;
 
         element = str("</") >> ident [& XmlParser::on_end_double] >> ch('>') |
                   lexeme(ch('<') >> ident [& XmlParser::element_name])
@@ -64,34 +51,29 @@ namespace ell
                                      ch('>') [& XmlParser::on_start_double]);
 
         attribute = ident [& XmlParser::attribute_name] >> ch('=')
-                    >> lexeme(ch('\"') >> * ((+ (any - chset("\"<&"))) [& XmlParser::push_string] |
+                    >> lexeme(ch('\"') >> * (jump("\"<&") [& XmlParser::push_string] |
                                              reference) >> ch('\"') |
-                                ch('\"') >> * ((+ (any - chset("\'<&"))) [& XmlParser::push_string] |
+                                ch('\'') >> * (jump("\'<&") [& XmlParser::push_string] |
                                                reference) >> ch('\'')) [& XmlParser::on_attribute];
 
-        reference = ch('&') >> (str("quot") [& XmlParser::push_quot] |
-                                str("apos") [& XmlParser::push_apos] |
-                                str("amp")  [& XmlParser::push_amp] |
-                                str("lt")   [& XmlParser::push_lt] |
-                                str("gt")   [& XmlParser::push_gt] |
-                                error("unkown entity")
-                                ) >> ch(';');
+        reference = XmlReference();
 
-        comment = str("<!--") >> any * str("-->");
+        comment = str("<!--") >> jump_to("-->") >> str("-->");
 
-        pi = str("<?") >> any * str("?>");
+        pi = str("<?") >> jump_to("?>") >> str("?>");
 
-        data = lexeme(+ ( (+ (any - (* blank >> ch('<') | ch('&')))) [& XmlParser::push_string]
+        data = lexeme(+ ( XmlText() [& XmlParser::push_string]
                         | reference
                         | * blank >> cdata )) [& XmlParser::on_data_];
 
         cdata = str("<![CDATA[")
-                >> lexeme(* (any - str("]]>")))[& XmlParser::push_string] >> str("]]>");
+                >> lexeme(jump_to("]]>"))[& XmlParser::push_string] >> str("]]>");
 
         ident = lexeme((chset("a-zA-Z_:") |
                        range<(char) 0x80, (char) 0xFF>()) >> * ( chset("a-zA-Z0-9_.:-") |
                                                                  range<(char) 0x80, (char) 0xFF>()));
         ELL_NAME_RULE(document);
+        ELL_NAME_RULE(item);
         ELL_NAME_RULE(element);
         ELL_NAME_RULE(attribute);
         ELL_NAME_RULE(reference);
@@ -101,6 +83,254 @@ namespace ell
         ELL_NAME_RULE(data);
         ELL_NAME_RULE(ident);
     }
+
+    inline XmlNode * XmlDomParser::reparse(const char * old_buffer, size_t begin, size_t end,
+                                           const std::string & replacement)
+    {
+        long bytes = (long) replacement.size() - (long) (end - begin);
+        int lines = (int) (std::count(replacement.begin(), replacement.end(), '\n') -
+                           std::count(old_buffer + begin, old_buffer + end, '\n'));
+
+        // Smallest element strictly enclosing the edit
+        XmlNode * e = & document;
+        for (XmlNode * c = document._first_child; c && c->source_begin < end; )
+        {
+            if (c->is_element() && c->source_begin < begin && end < c->source_end)
+            {
+                e = c;
+                c = c->_first_child;
+            }
+            else
+                c = c->_next_sibling;
+        }
+
+        XmlDomParser p(xml_grammar, & names);
+        p.set_entities(get_entities());
+        p.set_namespace_mode(use_namespaces);
+
+        if (e != & document)
+        {
+            std::string text(old_buffer + e->source_begin, begin - e->source_begin);
+            text += replacement;
+            text.append(old_buffer + end, e->source_end - end);
+
+            // The line of an element is the one ending its start tag
+            int line = e->line;
+            char quote = 0;
+            for (const char * c = old_buffer + e->source_begin; * c != '>' || quote; ++c)
+            {
+                if (quote)
+                    quote = * c == quote ? 0 : quote;
+                else if (* c == '\"' || * c == '\'')
+                    quote = * c;
+                if (* c == '\n')
+                    --line;
+            }
+
+            p.document.set_namespaces(e->_parent->get_namespaces());
+            p.parse(text.c_str(), line);
+            XmlNode * r = p.document._first_child;
+            if (r && r->is_element() && ! r->_next_sibling)
+            {
+                adopt(r, e->source_begin);
+                e->insert_sibling_node_before(r->detach());
+                delete e->detach();
+                shift_following(r, bytes, lines);
+                return r;
+            }
+            p.document.delete_children();
+        }
+
+        // Whole document
+        std::string text(old_buffer, begin);
+        text += replacement;
+        text += old_buffer + end;
+        p.parse(text.c_str());
+
+        document.delete_children();
+        while (XmlNode * c = p.document._first_child)
+        {
+            adopt(c, 0);
+            document.enqueue_child(c->detach());
+        }
+        current = & document;
+        return get_root();
+    }
+
+    inline void XmlDomParser::resolve_namespaces(XmlNode * element)
+    {
+        XmlNode * parent = element->_parent;
+        if (! parent->get_namespaces())
+        {
+            // Prefixes bound by definition
+            XmlNamespaces * scope = new XmlNamespaces;
+            scope->bind(intern("xml"), intern("http://www.w3.org/XML/1998/namespace"));
+            scope->bind(intern("xmlns"), intern("http://www.w3.org/2000/xmlns/"));
+            parent->set_namespaces(scope);
+        }
+
+        // A new scope only for elements declaring namespaces
+        const XmlNamespaces * inherited = parent->get_namespaces();
+        XmlNamespaces * scope = 0;
+        for (XmlAttributesMap::const_iterator i = element->attributes.begin(); i != element->attributes.end(); ++i)
+        {
+            XmlName prefix;
+            if (i->first == ell::string("xmlns"))
+                prefix = XmlName();
+            else if (i->first.prefix() == ell::string("xmlns"))
+                prefix = i->first.local();
+            else
+                continue;
+
+            if (prefix == ell::string("xmlns") || (! prefix.empty() && i->second.empty()))
+                raise_error("Invalid namespace declaration " + i->first.str(), element->line);
+
+            if (! scope)
+            {
+                scope = new XmlNamespaces;
+                scope->bindings = inherited->bindings;
+            }
+            scope->bind(prefix, intern(i->second));
+        }
+        element->set_namespaces(scope ? scope : parent->get_namespaces());
+
+        XmlName prefix = element->name.prefix();
+        if (! element->get_namespaces()->resolve(prefix, element->ns) && ! prefix.empty())
+            raise_error("Undeclared namespace prefix " + prefix.str(), element->line);
+
+        // Prefixes of attributes must be bound too
+        for (XmlAttributesMap::const_iterator i = element->attributes.begin(); i != element->attributes.end(); ++i)
+        {
+            XmlName uri;
+            if (! i->first.prefix().empty() && ! element->get_namespaces()->resolve(i->first.prefix(), uri))
+                raise_error("Undeclared namespace prefix " + i->first.prefix().str(), element->line);
+        }
+    }
+
+    inline void XmlDomParser::adopt(XmlNode * node, size_t offset)
+    {
+        node->parser = this;
+        if (node->is_element())
+        {
+            node->source_begin += offset;
+            node->source_end += offset;
+        }
+        for (XmlNode * c = node->_first_child; c; c = c->_next_sibling)
+            adopt(c, offset);
+    }
+
+    inline void XmlDomParser::disown(XmlNode * node)
+    {
+        node->parser = 0;
+        for (XmlNode * c = node->_first_child; c; c = c->_next_sibling)
+            disown(c);
+    }
+
+    inline void XmlDomParser::shift_following(XmlNode * node, long bytes, int lines)
+    {
+        struct Shift
+        {
+            static void subtree(XmlNode * n, long bytes, int lines)
+            {
+                n->line += lines;
+                if (n->is_element())
+                {
+                    n->source_begin += bytes;
+                    n->source_end += bytes;
+                }
+                for (XmlNode * c = n->_first_child; c; c = c->_next_sibling)
+                    subtree(c, bytes, lines);
+            }
+        };
+
+        for (XmlNode * n = node; n != & document; n = n->_parent)
+        {
+            for (XmlNode * s = n->_next_sibling; s; s = s->_next_sibling)
+                Shift::subtree(s, bytes, lines);
+            if (n->_parent != & document)
+                n->_parent->source_end += bytes;
+        }
+    }
+
+    inline void XmlParser::on_data_view(const ell::string & data)
+    {
+        // Runs containing references are already decoded in cdata
+        if (data.position != cdata.c_str())
+            cdata.assign(data.position, data.size());
+        on_data(cdata);
+        cdata.clear();
+    }
+
+    inline void XmlParser::skip_past(const char * s)
+    {
+        const char * p = strstr(position, s);
+        if (! p)
+            raise_error(std::string("Expecting ") + s + " before end", line_number);
+        p += strlen(s);
+        line_number += std::count(position, p, '\n');
+        position = p;
+    }
+
+    inline void XmlParser::skip_element()
+    {
+        for (size_t depth = 1; depth; )
+        {
+            skip_past("<");
+
+            switch (* position)
+            {
+            case '/':
+                skip_past(">");
+                --depth;
+                break;
+
+            case '?':
+                skip_past("?>");
+                break;
+
+            case '!':
+                if (! strncmp(position, "!--", 3))
+                    skip_past("-->");
+                else if (! strncmp(position, "![CDATA[", 8))
+                    skip_past("]]>");
+                else
+                    skip_past(">");
+                break;
+
+            default:
+                // Start tag: look for its end outside attribute values
+                for (;;)
+                {
+                    position += strcspn(position, "\"'>\n");
+                    if (* position == '\n')
+                    {
+                        ++line_number;
+                        ++position;
+                    }
+                    else if (* position == '\"')
+                    {
+                        ++position;
+                        skip_past("\"");
+                    }
+                    else if (* position == '\'')
+                    {
+                        ++position;
+                        skip_past("'");
+                    }
+                    else
+                        break;
+                }
+
+                if (! * position)
+                    raise_error("Unclosed start tag", line_number);
+                if (position[-1] != '/')
+                    ++depth;
+                ++position;
+            }
+        }
+
+        elements.pop();
+    }
 }
 
 #endif // INCLUDED_ELL_IMPL_XMLPARSER_H
@@ -0,0 +1,400 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLQUERY_H
+#define INCLUDED_ELL_IMPL_XMLQUERY_H
+
+#include <algorithm>
+
+namespace ell
+{
+    /// Parser of XmlQuery paths
+    struct XmlQueryCompiler : public Parser<char>, public Grammar<char>
+    {
+        XmlQueryCompiler(XmlQuery & query)
+          : Parser<char>(& path, & blank),
+            query(query),
+            descendant(false)
+        {
+            flags.look_ahead = false;
+
+            path = ! (str("//") [& XmlQueryCompiler::on_root_descendant] |
+                      ch('/') [& XmlQueryCompiler::on_root])
+                   >> step >> * ((str("//") [& XmlQueryCompiler::on_descendant] |
+                                  ch('/') [& XmlQueryCompiler::on_child]) >> step)
+                   >> Grammar<char>::end;
+
+            step = (str("text()") [& XmlQueryCompiler::on_text] |
+                    ch('*') [& XmlQueryCompiler::on_any] |
+                    name [& XmlQueryCompiler::on_name]) >> * predicate;
+
+            predicate = ch('[') >> (dec [& XmlQueryCompiler::on_position] |
+                                    str("last()") [& XmlQueryCompiler::on_last] |
+                                    ch('@') >> name [& XmlQueryCompiler::on_attribute]
+                                    >> ! (ch('=') >> (lexeme(ch('\"') >> (* (any - ch('\"'))) [& XmlQueryCompiler::on_value] >> ch('\"')) |
+                                                      lexeme(ch('\'') >> (* (any - ch('\''))) [& XmlQueryCompiler::on_value] >> ch('\'')))))
+                        >> ch(']');
+
+            name = lexeme((chset("a-zA-Z_:") |
+                          range<(char) 0x80, (char) 0xFF>()) >> * ( chset("a-zA-Z0-9_.:-") |
+                                                                    range<(char) 0x80, (char) 0xFF>()));
+            ELL_NAME_RULE(path);
+            ELL_NAME_RULE(step);
+            ELL_NAME_RULE(predicate);
+            ELL_NAME_RULE(name);
+        }
+
+        void on_root() { query.absolute = true; }
+        void on_root_descendant() { query.absolute = true; descendant = true; }
+        void on_child() { descendant = false; }
+        void on_descendant() { descendant = true; }
+
+        void push_step(XmlQuery::Step::Test test, const std::string & n = "")
+        {
+            query.steps.push_back(XmlQuery::Step());
+            XmlQuery::Step & s = query.steps.back();
+            s.descendant = descendant;
+            s.test = test;
+            s.name = n;
+        }
+
+        void on_text() { push_step(XmlQuery::Step::TEXT); }
+        void on_any() { push_step(XmlQuery::Step::ANY_ELEMENT); }
+        void on_name(const std::string & n) { push_step(XmlQuery::Step::ELEMENT, n); }
+
+        XmlQuery::Predicate & push_predicate(XmlQuery::Predicate::Kind kind)
+        {
+            query.steps.back().predicates.push_back(XmlQuery::Predicate());
+            XmlQuery::Predicate & p = query.steps.back().predicates.back();
+            p.kind = kind;
+            p.position = 0;
+            return p;
+        }
+
+        void on_position(unsigned long n) { push_predicate(XmlQuery::Predicate::POSITION).position = n; }
+        void on_last() { push_predicate(XmlQuery::Predicate::LAST); }
+        void on_attribute(const std::string & n) { push_predicate(XmlQuery::Predicate::HAS_ATTRIBUTE).name = n; }
+
+        void on_value(const std::string & v)
+        {
+            XmlQuery::Predicate & p = query.steps.back().predicates.back();
+            p.kind = XmlQuery::Predicate::ATTRIBUTE_EQUALS;
+            p.value = v;
+        }
+
+        Rule<char> path, step, predicate, name;
+        XmlQuery & query;
+        bool descendant;
+    };
+
+    inline XmlQuery::XmlQuery(const std::string & path)
+      : absolute(false)
+    {
+        XmlQueryCompiler c(* this);
+        c.parse(path.c_str());
+    }
+
+    inline const XmlIndex::Structure & XmlIndex::structure() const
+    {
+        if (! has_structure.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (! has_structure.load(std::memory_order_relaxed))
+            {
+                Structure & s = structure_;
+
+                // Depth-first walk numbering nodes in document order
+                for (XmlNode * n = root; n; )
+                {
+                    uint32_t i = (uint32_t) s.nodes.size();
+                    s.nodes.push_back(n);
+                    s.ordinals[n] = i;
+                    uint32_t parent = npos;
+                    if (n != root)
+                        parent = s.ordinals[n->_parent];
+                    s.parents.push_back(parent);
+                    s.subtree_end.push_back(0);
+
+                    if (n->_first_child)
+                    {
+                        n = n->_first_child;
+                        continue;
+                    }
+
+                    // Close subtrees until a next sibling is found
+                    for (;;)
+                    {
+                        s.subtree_end[s.ordinals[n]] = (uint32_t) s.nodes.size();
+                        if (n == root)
+                        {
+                            n = 0;
+                            break;
+                        }
+                        if (n->_next_sibling)
+                        {
+                            n = n->_next_sibling;
+                            break;
+                        }
+                        n = n->_parent;
+                    }
+                }
+
+                s.child_begin.resize(s.nodes.size() + 1);
+                for (uint32_t i = 0; i < s.nodes.size(); ++i)
+                {
+                    s.child_begin[i] = (uint32_t) s.child_nodes.size();
+                    for (XmlNode * c = s.nodes[i]->_first_child; c; c = c->_next_sibling)
+                        s.child_nodes.push_back(c);
+                }
+                s.child_begin[s.nodes.size()] = (uint32_t) s.child_nodes.size();
+
+                has_structure.store(true, std::memory_order_release);
+            }
+        }
+        return structure_;
+    }
+
+    inline const XmlIndex::NameIndex & XmlIndex::names() const
+    {
+        const Structure & s = structure();
+        if (! has_names.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (! has_names.load(std::memory_order_relaxed))
+            {
+                for (uint32_t i = 0; i < s.nodes.size(); ++i)
+                {
+                    if (s.nodes[i]->is_element())
+                    {
+                        const std::string & n = s.nodes[i]->name.str();
+                        names_[n].push_back(i);
+                        node_names_[n].push_back(s.nodes[i]);
+                    }
+                }
+                has_names.store(true, std::memory_order_release);
+            }
+        }
+        return names_;
+    }
+
+    inline const XmlIndex::IdIndex & XmlIndex::ids() const
+    {
+        const Structure & s = structure();
+        if (! has_ids.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (! has_ids.load(std::memory_order_relaxed))
+            {
+                for (uint32_t i = 0; i < s.nodes.size(); ++i)
+                {
+                    const XmlNode * n = s.nodes[i];
+                    if (n->is_element())
+                    {
+                        XmlAttributesMap::const_iterator a = n->attributes.find(ell::string(id_attribute));
+                        if (a != n->attributes.end())
+                            ids_.insert(std::make_pair(a->second, s.nodes[i]));
+                    }
+                }
+                has_ids.store(true, std::memory_order_release);
+            }
+        }
+        return ids_;
+    }
+
+    inline void XmlIndex::reset()
+    {
+        structure_ = Structure();
+        names_.clear();
+        node_names_.clear();
+        ids_.clear();
+        has_structure = has_names = has_ids = false;
+    }
+
+    inline uint32_t XmlIndex::ordinal(const XmlNode * node) const
+    {
+        const Structure & s = structure();
+        std::unordered_map<const XmlNode *, uint32_t>::const_iterator i = s.ordinals.find(node);
+        if (i == s.ordinals.end())
+            throw std::runtime_error("Node not in index: " + node->describe());
+        return i->second;
+    }
+
+    inline XmlNodeRange XmlIndex::children(const XmlNode * node) const
+    {
+        const Structure & s = structure();
+        uint32_t i = ordinal(node);
+        if (s.child_begin[i] == s.child_begin[i + 1])
+            return XmlNodeRange();
+        XmlNode * const * base = & s.child_nodes[0];
+        return XmlNodeRange(base + s.child_begin[i], base + s.child_begin[i + 1]);
+    }
+
+    inline XmlNodeRange XmlIndex::elements_named(const ell::string & name) const
+    {
+        names();
+        NodeNameIndex::const_iterator i = node_names_.find(name.str());
+        if (i == node_names_.end())
+            return XmlNodeRange();
+        return XmlNodeRange(& i->second[0], & i->second[0] + i->second.size());
+    }
+
+    inline XmlNode * XmlIndex::element_by_id(const ell::string & id) const
+    {
+        IdIndex::const_iterator i = ids().find(id.str());
+        return i == ids().end() ? 0 : i->second;
+    }
+
+    inline bool XmlIndex::match_test(const XmlQuery::Step & step, const XmlNode * node) const
+    {
+        switch (step.test)
+        {
+        case XmlQuery::Step::TEXT: return node->is_data();
+        case XmlQuery::Step::ANY_ELEMENT: return node->is_element();
+        default: return node->name == ell::string(step.name);
+        }
+    }
+
+    inline void XmlIndex::candidates(const XmlQuery::Step & step, uint32_t context, std::vector<uint32_t> & out) const
+    {
+        const Structure & s = structure();
+        uint32_t end = s.subtree_end[context];
+
+        if (! step.descendant)
+        {
+            for (uint32_t i = context + 1; i < end; i = s.subtree_end[i])
+            {
+                if (match_test(step, s.nodes[i]))
+                    out.push_back(i);
+            }
+        }
+        else if (step.test == XmlQuery::Step::ELEMENT)
+        {
+            // Descendants with that name are a slice of the name index
+            NameIndex::const_iterator n = names().find(step.name);
+            if (n != names().end())
+            {
+                std::vector<uint32_t>::const_iterator b = std::upper_bound(n->second.begin(), n->second.end(), context),
+                                                      e = std::lower_bound(b, n->second.end(), end);
+                out.insert(out.end(), b, e);
+            }
+        }
+        else
+        {
+            for (uint32_t i = context + 1; i < end; ++i)
+            {
+                if (match_test(step, s.nodes[i]))
+                    out.push_back(i);
+            }
+        }
+    }
+
+    inline void XmlIndex::filter(const XmlQuery::Step & step, std::vector<uint32_t> & group) const
+    {
+        for (std::vector<XmlQuery::Predicate>::const_iterator p = step.predicates.begin();
+             p != step.predicates.end() && ! group.empty();
+             ++p)
+        {
+            switch (p->kind)
+            {
+            case XmlQuery::Predicate::POSITION:
+                if (p->position >= 1 && p->position <= group.size())
+                    group.assign(1, group[p->position - 1]);
+                else
+                    group.clear();
+                break;
+
+            case XmlQuery::Predicate::LAST:
+                group.assign(1, group.back());
+                break;
+
+            default:
+                {
+                    std::vector<uint32_t>::iterator o = group.begin();
+                    for (std::vector<uint32_t>::const_iterator i = group.begin(); i != group.end(); ++i)
+                    {
+                        const XmlNode * n = structure_.nodes[* i];
+                        if (n->is_element())
+                        {
+                            XmlAttributesMap::const_iterator a = n->attributes.find(ell::string(p->name));
+                            if (a != n->attributes.end() &&
+                                (p->kind == XmlQuery::Predicate::HAS_ATTRIBUTE || a->second == p->value))
+                                * o++ = * i;
+                        }
+                    }
+                    group.erase(o, group.end());
+                }
+            }
+        }
+    }
+
+    inline std::vector<XmlNode *> XmlIndex::select(const XmlQuery & query, XmlNode * context) const
+    {
+        const Structure & s = structure();
+        std::vector<uint32_t> current(1, query.absolute || ! context ? 0 : ordinal(context));
+        std::vector<uint32_t> next, found, group;
+
+        for (std::vector<XmlQuery::Step>::const_iterator step = query.steps.begin();
+             step != query.steps.end() && ! current.empty();
+             ++step)
+        {
+            next.clear();
+            for (std::vector<uint32_t>::const_iterator c = current.begin(); c != current.end(); ++c)
+            {
+                found.clear();
+                candidates(* step, * c, found);
+                if (step->predicates.empty())
+                {
+                    next.insert(next.end(), found.begin(), found.end());
+                    continue;
+                }
+
+                // Positions are relative to nodes of the same parent
+                std::vector<std::pair<uint32_t, uint32_t> > by_parent;
+                for (std::vector<uint32_t>::const_iterator i = found.begin(); i != found.end(); ++i)
+                    by_parent.push_back(std::make_pair(s.parents[* i], * i));
+                std::sort(by_parent.begin(), by_parent.end());
+
+                for (size_t i = 0; i < by_parent.size(); )
+                {
+                    group.clear();
+                    size_t j = i;
+                    for (; j < by_parent.size() && by_parent[j].first == by_parent[i].first; ++j)
+                        group.push_back(by_parent[j].second);
+                    filter(* step, group);
+                    next.insert(next.end(), group.begin(), group.end());
+                    i = j;
+                }
+            }
+
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+            current.swap(next);
+        }
+
+        std::vector<XmlNode *> result;
+        result.reserve(current.size());
+        for (std::vector<uint32_t>::const_iterator i = current.begin(); i != current.end(); ++i)
+            result.push_back(s.nodes[* i]);
+        return result;
+    }
+
+    inline XmlNode * XmlIndex::select_first(const std::string & path, XmlNode * context) const
+    {
+        std::vector<XmlNode *> r = select(path, context);
+        return r.empty() ? 0 : r.front();
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLQUERY_H
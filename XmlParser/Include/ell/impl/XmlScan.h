@@ -0,0 +1,196 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLSCAN_H
+#define INCLUDED_ELL_IMPL_XMLSCAN_H
+
+namespace ell
+{
+    inline ELL_XML_NO_SANITIZE
+    const char * xml_find(const char * p, const char * stops, int & lines)
+    {
+#       if defined(__SSE2__) && defined(__GNUC__)
+        size_t n = strlen(stops);
+        assert(n <= 4);
+        __m128i sets[4];
+        for (size_t i = 0; i < n; ++i)
+            sets[i] = _mm_set1_epi8(stops[i]);
+        const __m128i zero = _mm_setzero_si128(), newline = _mm_set1_epi8('\n');
+
+        const char * block = (const char *) ((uintptr_t) p & ~ (uintptr_t) 15);
+        unsigned int skip = p - block;
+        for (;; block += 16, skip = 0)
+        {
+            __m128i v = _mm_load_si128((const __m128i *) block);
+            __m128i m = _mm_cmpeq_epi8(v, zero);
+            for (size_t i = 0; i < n; ++i)
+                m = _mm_or_si128(m, _mm_cmpeq_epi8(v, sets[i]));
+
+            unsigned int stop = (unsigned int) _mm_movemask_epi8(m) >> skip << skip;
+            unsigned int nl = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) >> skip << skip;
+            if (stop)
+            {
+                unsigned int i = __builtin_ctz(stop);
+                lines += __builtin_popcount(nl & ((1u << i) - 1));
+                return block + i;
+            }
+            lines += __builtin_popcount(nl);
+        }
+#       else
+        for (; * p && ! strchr(stops, * p); ++p)
+        {
+            if (* p == '\n')
+                ++lines;
+        }
+        return p;
+#       endif
+    }
+
+    inline void XmlStructuralIndex::build(const char * buffer, size_t n)
+    {
+        base = buffer;
+        size = n;
+        structural.assign(n / 64 + 1, 0);
+        newlines.assign(n / 64 + 1, 0);
+
+        size_t i = 0;
+#       if defined(__SSE2__)
+        const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>'), amp = _mm_set1_epi8('&'),
+                      quot = _mm_set1_epi8('\"'), apos = _mm_set1_epi8('\''), newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (buffer + i));
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, amp),
+                                                  _mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, apos))));
+            structural[i / 64] |= (uint64_t) (unsigned int) _mm_movemask_epi8(m) << (i % 64);
+            newlines[i / 64] |= (uint64_t) (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << (i % 64);
+        }
+#       endif
+        for (; i < n; ++i)
+        {
+            char c = buffer[i];
+            if (c == '<' || c == '>' || c == '&' || c == '\"' || c == '\'')
+                structural[i / 64] |= (uint64_t) 1 << (i % 64);
+            else if (c == '\n')
+                newlines[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+    }
+
+    inline size_t XmlStructuralIndex::next(const std::vector<uint64_t> & bits, size_t i) const
+    {
+        size_t w = i / 64;
+        uint64_t word = bits[w] & (~ (uint64_t) 0 << (i % 64));
+        while (! word)
+        {
+            if (++w == bits.size())
+                return size;
+            word = bits[w];
+        }
+        return std::min(w * 64 + __builtin_ctzll(word), size);
+    }
+
+    inline int XmlStructuralIndex::count(const std::vector<uint64_t> & bits, size_t begin, size_t end)
+    {
+        int n = 0;
+        for (size_t w = begin / 64; w * 64 < end; ++w)
+        {
+            uint64_t word = bits[w];
+            if (w == begin / 64)
+                word &= ~ (uint64_t) 0 << (begin % 64);
+            if (w == end / 64)
+                word &= ((uint64_t) 1 << (end % 64)) - 1;
+            n += __builtin_popcountll(word);
+        }
+        return n;
+    }
+
+    inline const char * XmlStructuralIndex::find(const char * p, const char * stops, int & lines) const
+    {
+        size_t begin = p - base, i = begin;
+        for (; (i = next(structural, i)) < size && ! strchr(stops, base[i]); ++i)
+            ;
+        lines += count(newlines, begin, i);
+        return base + i;
+    }
+
+    inline bool XmlJump::match(Parser<char> * parser, Storage<void> &) const
+    {
+        ELL_BEGIN_PARSE
+        XmlParser * xml_parser = static_cast<XmlParser *>(parser);
+        const char * begin = parser->position, * end;
+        int lines = 0;
+
+        if (terminator.empty())
+        {
+            end = xml_parser->find(begin, stops.c_str(), lines);
+            match = end != begin;
+        }
+        else
+        {
+            // Look for the last character of the terminator, then check the other ones
+            size_t n = terminator.size() - 1;
+            const char last[2] = { terminator[n], 0 };
+            for (end = begin; ; ++end)
+            {
+                end = xml_parser->find(end, last, lines);
+                if (! * end)
+                    break;
+                if (end >= begin + n && ! memcmp(end - n, terminator.c_str(), n))
+                {
+                    end -= n;
+                    match = true;
+                    break;
+                }
+            }
+        }
+
+        if (match)
+        {
+            parser->position = end;
+            parser->line_number += lines;
+        }
+        ELL_END_PARSE
+    }
+
+    inline bool XmlText::match(Parser<char> * parser, Storage<void> &) const
+    {
+        ELL_BEGIN_PARSE
+        XmlParser * xml_parser = static_cast<XmlParser *>(parser);
+        const char * begin = parser->position;
+        int lines = 0;
+        const char * end = xml_parser->find(begin, "<&", lines);
+
+        if (* end == '<')
+        {
+            // Back off the trailing blanks
+            while (end > begin && strchr(" \t\n\r\v", end[-1]))
+            {
+                if (* --end == '\n')
+                    --lines;
+            }
+        }
+
+        match = end != begin;
+        if (match)
+        {
+            parser->position = end;
+            parser->line_number += lines;
+        }
+        ELL_END_PARSE
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLSCAN_H
@@ -0,0 +1,325 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLSCHEMA_H
+#define INCLUDED_ELL_IMPL_XMLSCHEMA_H
+
+#include <algorithm>
+#include <map>
+
+namespace ell
+{
+    /// Parser of content models, compiling them into DFAs
+    ///
+    /// The syntax tree is built bottom-up on a stack of terms, then turned
+    /// into a Glushkov automaton (one state per name occurrence), which is
+    /// made deterministic by the subset construction.
+    struct XmlContentModelCompiler : public Parser<char>, public Grammar<char>
+    {
+        struct Term
+        {
+            enum Kind { EMPTY, NAME, SEQUENCE, CHOICE, OPTIONAL, STAR, PLUS };
+
+            Kind kind;
+            uint32_t left, right, id;
+        };
+
+        XmlContentModelCompiler(XmlNameTable & names, XmlContentModel & model)
+          : Parser<char>(& content, & blank),
+            names(names),
+            model(model)
+        {
+            flags.look_ahead = false;
+
+            content = (str("EMPTY") [& XmlContentModelCompiler::on_empty] |
+                       str("ANY") [& XmlContentModelCompiler::on_any] |
+                       ch('(') >> (mixed | group >> occurrence)) >> Grammar<char>::end;
+
+            mixed = str("#PCDATA") [& XmlContentModelCompiler::on_pcdata]
+                    >> * (ch('|') >> name [& XmlContentModelCompiler::on_mixed_name])
+                    >> ch(')') >> ! ch('*');
+
+            group = particle >> (+ (ch('|') >> particle [& XmlContentModelCompiler::on_choice]) |
+                                 * (ch(',') >> particle [& XmlContentModelCompiler::on_sequence])) >> ch(')');
+
+            particle = (name [& XmlContentModelCompiler::on_name] | ch('(') >> group) >> occurrence;
+
+            occurrence = ! (ch('?') [& XmlContentModelCompiler::on_optional] |
+                            ch('*') [& XmlContentModelCompiler::on_star] |
+                            ch('+') [& XmlContentModelCompiler::on_plus]);
+
+            name = lexeme((chset("a-zA-Z_:") |
+                          range<(char) 0x80, (char) 0xFF>()) >> * ( chset("a-zA-Z0-9_.:-") |
+                                                                    range<(char) 0x80, (char) 0xFF>()));
+            ELL_NAME_RULE(content);
+            ELL_NAME_RULE(mixed);
+            ELL_NAME_RULE(group);
+            ELL_NAME_RULE(particle);
+            ELL_NAME_RULE(occurrence);
+            ELL_NAME_RULE(name);
+        }
+
+        /// Build the DFA of the parsed model
+        void compile();
+
+        void push(Term::Kind kind, uint32_t left = 0, uint32_t right = 0, uint32_t id = 0)
+        {
+            Term t = { kind, left, right, id };
+            stack.push_back((uint32_t) terms.size());
+            terms.push_back(t);
+        }
+
+        /// Replace the top of the stack by the given unary term
+        void unary(Term::Kind kind)
+        {
+            uint32_t x = stack.back();
+            stack.pop_back();
+            push(kind, x);
+        }
+
+        /// Replace the two terms on top of the stack by the given binary term
+        void binary(Term::Kind kind)
+        {
+            uint32_t r = stack.back();
+            stack.pop_back();
+            uint32_t l = stack.back();
+            stack.pop_back();
+            push(kind, l, r);
+        }
+
+        void on_empty() { push(Term::EMPTY); }
+        void on_any() { model.any = model.mixed = true; }
+        void on_pcdata() { model.mixed = true; push(Term::EMPTY); }
+        void on_name(const std::string & n) { push(Term::NAME, 0, 0, names.intern(n).id()); }
+        void on_mixed_name(const std::string & n) { on_name(n); binary(Term::CHOICE); }
+        void on_choice() { binary(Term::CHOICE); }
+        void on_sequence() { binary(Term::SEQUENCE); }
+        void on_optional() { unary(Term::OPTIONAL); }
+        void on_star() { unary(Term::STAR); }
+        void on_plus() { unary(Term::PLUS); }
+
+        Rule<char> content, mixed, group, particle, occurrence, name;
+        XmlNameTable & names;
+        XmlContentModel & model;
+
+        /// Terms, children before their parents
+        std::vector<Term> terms;
+        std::vector<uint32_t> stack;
+    };
+
+    inline void XmlContentModelCompiler::compile()
+    {
+        if (model.any)
+            return;
+
+        typedef std::vector<uint32_t> Positions;
+
+        if (model.mixed)
+            unary(Term::STAR);
+
+        // Glushkov sets, for each term
+        std::vector<bool> nullable(terms.size());
+        std::vector<Positions> first(terms.size()), last(terms.size());
+        std::vector<uint32_t> symbols;
+        std::vector<Positions> follow;
+
+        for (uint32_t i = 0; i < terms.size(); ++i)
+        {
+            const Term & t = terms[i];
+            switch (t.kind)
+            {
+            case Term::EMPTY:
+                nullable[i] = true;
+                break;
+            case Term::NAME:
+                first[i].push_back((uint32_t) symbols.size());
+                last[i] = first[i];
+                symbols.push_back(t.id);
+                follow.push_back(Positions());
+                break;
+            case Term::SEQUENCE:
+                nullable[i] = nullable[t.left] && nullable[t.right];
+                first[i] = first[t.left];
+                if (nullable[t.left])
+                    first[i].insert(first[i].end(), first[t.right].begin(), first[t.right].end());
+                last[i] = last[t.right];
+                if (nullable[t.right])
+                    last[i].insert(last[i].end(), last[t.left].begin(), last[t.left].end());
+                for (Positions::const_iterator p = last[t.left].begin(); p != last[t.left].end(); ++p)
+                    follow[* p].insert(follow[* p].end(), first[t.right].begin(), first[t.right].end());
+                break;
+            case Term::CHOICE:
+                nullable[i] = nullable[t.left] || nullable[t.right];
+                first[i] = first[t.left];
+                first[i].insert(first[i].end(), first[t.right].begin(), first[t.right].end());
+                last[i] = last[t.left];
+                last[i].insert(last[i].end(), last[t.right].begin(), last[t.right].end());
+                break;
+            case Term::OPTIONAL:
+            case Term::STAR:
+            case Term::PLUS:
+                nullable[i] = t.kind != Term::PLUS || nullable[t.left];
+                first[i] = first[t.left];
+                last[i] = last[t.left];
+                if (t.kind != Term::OPTIONAL)
+                {
+                    for (Positions::const_iterator p = last[t.left].begin(); p != last[t.left].end(); ++p)
+                        follow[* p].insert(follow[* p].end(), first[t.left].begin(), first[t.left].end());
+                }
+                break;
+            }
+        }
+
+        // The initial state is a virtual position followed by the first ones
+        uint32_t root = stack.back();
+        uint32_t start = (uint32_t) symbols.size();
+        follow.push_back(first[root]);
+        std::vector<bool> final_position(symbols.size() + 1, false);
+        for (Positions::const_iterator p = last[root].begin(); p != last[root].end(); ++p)
+            final_position[* p] = true;
+        final_position[start] = nullable[root];
+
+        // Subset construction
+        model.width = (uint32_t) names.size() + 1;
+        std::map<Positions, uint32_t> ids;
+        std::vector<Positions> states(1, Positions(1, start));
+        ids[states[0]] = 0;
+        for (uint32_t s = 0; s < states.size(); ++s)
+        {
+            model.transitions.resize((s + 1) * model.width, (uint32_t) XmlContentModel::dead);
+
+            bool accepting = false;
+            std::map<uint32_t, Positions> next;
+            for (Positions::const_iterator p = states[s].begin(); p != states[s].end(); ++p)
+            {
+                accepting = accepting || final_position[* p];
+                for (Positions::const_iterator q = follow[* p].begin(); q != follow[* p].end(); ++q)
+                    next[symbols[* q]].push_back(* q);
+            }
+            model.accepting.push_back(accepting);
+
+            for (std::map<uint32_t, Positions>::iterator i = next.begin(); i != next.end(); ++i)
+            {
+                Positions & n = i->second;
+                std::sort(n.begin(), n.end());
+                n.erase(std::unique(n.begin(), n.end()), n.end());
+
+                std::map<Positions, uint32_t>::const_iterator k = ids.find(n);
+                uint32_t target;
+                if (k == ids.end())
+                {
+                    target = (uint32_t) states.size();
+                    ids[n] = target;
+                    states.push_back(n);
+                }
+                else
+                    target = k->second;
+                model.transitions[s * model.width + i->first] = target;
+            }
+        }
+    }
+
+    inline void XmlSchema::element(const std::string & name, const std::string & content_model)
+    {
+        XmlContentModel m;
+        m.source = "<!ELEMENT " + name + " " + content_model + ">";
+        XmlContentModelCompiler c(names, m);
+        c.parse(content_model.c_str());
+        c.compile();
+
+        declared(name) = m;
+    }
+
+    inline XmlContentModel & XmlSchema::declared(const std::string & name)
+    {
+        uint32_t id = names.intern(name).id();
+        if (id >= models_by_id.size())
+            models_by_id.resize(id + 1, (uint32_t) XmlContentModel::dead);
+        if (models_by_id[id] != XmlContentModel::dead)
+            throw std::runtime_error("Element declared twice: " + name);
+
+        models_by_id[id] = (uint32_t) models.size();
+        models.push_back(XmlContentModel());
+        return models.back();
+    }
+
+    inline void XmlSchema::require_attribute(const std::string & element, const std::string & attribute)
+    {
+        uint32_t id = names.find(element).id();
+        if (! model(names.find(element)))
+            throw std::runtime_error("Undeclared element: " + element);
+        models[models_by_id[id]].required.push_back(names.intern(attribute));
+    }
+
+    inline void XmlValidation::start_element(const Parser<char> & parser, const ell::string & name,
+                                             const XmlAttributeViews & attrs)
+    {
+        XmlName n = schema.names.find(name);
+        const XmlContentModel * m = schema.model(n);
+        if (! m)
+            parser.raise_error("Undeclared element `" + name + "`");
+
+        if (stack.empty())
+        {
+            if (! schema.root.empty() && n != schema.root)
+                parser.raise_error("Root element must be `" + schema.root.str() + "`");
+        }
+        else
+        {
+            Frame & f = stack.back();
+            if (! f.model->any)
+            {
+                uint32_t s = f.model->next(f.state, n.id());
+                if (s == XmlContentModel::dead)
+                    parser.raise_error("Element `" + name + "` not allowed by " + f.model->source);
+                f.state = s;
+            }
+        }
+
+        for (std::vector<XmlName>::const_iterator r = m->required.begin(); r != m->required.end(); ++r)
+        {
+            XmlAttributeViews::const_iterator i = attrs.begin();
+            while (i != attrs.end() && ! (i->first == r->str()))
+                ++i;
+            if (i == attrs.end())
+                parser.raise_error("Missing attribute `" + r->str() + "` of element `" + name + "`");
+        }
+
+        Frame f = { m, 0 };
+        stack.push_back(f);
+    }
+
+    inline void XmlValidation::end_element(const Parser<char> & parser)
+    {
+        const Frame & f = stack.back();
+        if (! f.model->any && ! f.model->accepting[f.state])
+            parser.raise_error("Missing children required by " + f.model->source);
+        stack.pop_back();
+    }
+
+    inline void XmlValidation::data(const Parser<char> & parser, const ell::string & data)
+    {
+        if (stack.empty() || stack.back().model->mixed)
+            return;
+
+        for (const char * c = data.position, * e = data.position + data.size(); c != e; ++c)
+        {
+            if (! isspace((unsigned char) * c))
+                parser.raise_error("Text not allowed by " + stack.back().model->source);
+        }
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLSCHEMA_H
@@ -0,0 +1,288 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLSERIALIZER_H
+#define INCLUDED_ELL_IMPL_XMLSERIALIZER_H
+
+namespace ell
+{
+#if ELL_XML_WRITEV
+    inline void XmlFdOutput::close_segment()
+    {
+        if (used > segment_begin)
+        {
+            struct iovec v;
+            v.iov_base = & buffer[segment_begin];
+            v.iov_len = used - segment_begin;
+            segments.push_back(v);
+            segment_begin = used;
+        }
+    }
+
+    inline void XmlFdOutput::write_ref(const char * s, size_t size)
+    {
+        if (size < threshold)
+        {
+            write(s, size);
+            return;
+        }
+
+        // Written from its own place
+        close_segment();
+        struct iovec v;
+        v.iov_base = const_cast<char *>(s);
+        v.iov_len = size;
+        segments.push_back(v);
+    }
+
+    inline void XmlFdOutput::overflow(const char * s, size_t size)
+    {
+        flush();
+        if (size < buffer.size())
+        {
+            write(s, size);
+            return;
+        }
+
+        // Bigger than the buffer: written now, while the bytes are valid
+        struct iovec v;
+        v.iov_base = const_cast<char *>(s);
+        v.iov_len = size;
+        segments.push_back(v);
+        flush();
+    }
+
+    inline void XmlFdOutput::flush()
+    {
+#       ifdef IOV_MAX
+        const size_t max_segments = IOV_MAX;
+#       else
+        const size_t max_segments = 16;
+#       endif
+
+        close_segment();
+
+        for (size_t i = 0; i < segments.size(); )
+        {
+            ssize_t n = ::writev(fd, & segments[i], (int) std::min(segments.size() - i, max_segments));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                int e = errno;
+                segments.clear();
+                used = segment_begin = 0;
+                throw std::runtime_error(std::string("Cannot write XML: ") + strerror(e));
+            }
+
+            // Skip written segments, and the written part of the last one
+            for (size_t left = n; left; )
+            {
+                if (left >= segments[i].iov_len)
+                {
+                    left -= segments[i].iov_len;
+                    ++i;
+                }
+                else
+                {
+                    segments[i].iov_base = (char *) segments[i].iov_base + left;
+                    segments[i].iov_len -= left;
+                    left = 0;
+                }
+            }
+        }
+
+        segments.clear();
+        used = segment_begin = 0;
+    }
+#endif
+
+    inline const bool * XmlSerializer::make_table(bool * table, const char * chars)
+    {
+        for (; * chars; ++chars)
+            table[(unsigned char) * chars] = true;
+        return table;
+    }
+
+    inline const bool * XmlSerializer::all_specials()
+    {
+        static bool table[256];
+        static const bool * t = make_table(table, "\"'&<>");
+        return t;
+    }
+
+    inline const bool * XmlSerializer::text_specials()
+    {
+        static bool table[256];
+        static const bool * t = make_table(table, "&<>");
+        return t;
+    }
+
+    inline const bool * XmlSerializer::attribute_specials()
+    {
+        static bool table[256];
+        static const bool * t = make_table(table, "\"&<");
+        return t;
+    }
+
+    inline const char * XmlSerializer::find_special(const char * begin, const char * end, const bool * table)
+    {
+#       if defined(__SSE2__) && defined(__GNUC__)
+        // Look for any special character 16 bytes at a time,
+        // then check candidates with the table
+        const __m128i quot = _mm_set1_epi8('\"'), apos = _mm_set1_epi8('\''),
+                      amp = _mm_set1_epi8('&'), lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+
+        for (; end - begin >= 16; begin += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) begin);
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, apos)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, amp),
+                                                  _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt))));
+            for (unsigned int mask = _mm_movemask_epi8(m); mask; mask &= mask - 1)
+            {
+                const char * p = begin + __builtin_ctz(mask);
+                if (table[(unsigned char) * p])
+                    return p;
+            }
+        }
+#       endif
+
+        while (begin != end && ! table[(unsigned char) * begin])
+            ++begin;
+        return begin;
+    }
+
+    inline const char * XmlSerializer::entity(char c)
+    {
+        switch (c)
+        {
+        case '\"': return "&quot;";
+        case '\'': return "&apos;";
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        default: return "&gt;";
+        }
+    }
+
+    inline void XmlSerializer::escape(XmlOutput & out, const char * s, size_t size, const bool * table,
+                                      bool stable)
+    {
+        const char * end = s + size;
+        for (;;)
+        {
+            const char * p = find_special(s, end, table);
+            if (stable)
+                out.write_ref(s, p - s);
+            else
+                out.write(s, p - s);
+            if (p == end)
+                break;
+
+            const char * e = entity(* p);
+            out.write(e, strlen(e));
+            s = p + 1;
+        }
+    }
+
+    inline void XmlSerializer::write_text(const char * s, size_t size, bool pretty)
+    {
+        escape(out, s, size, pretty ? all_specials() : text_specials());
+    }
+
+    inline void XmlSerializer::write_attribute_value(const char * s, size_t size, bool pretty)
+    {
+        escape(out, s, size, pretty ? all_specials() : attribute_specials());
+    }
+
+    inline void XmlSerializer::write_indent(size_t n)
+    {
+        static const char spaces[] = "                                ";
+        for (; n > sizeof(spaces) - 1; n -= sizeof(spaces) - 1)
+            out.write(spaces, sizeof(spaces) - 1);
+        out.write(spaces, n);
+    }
+
+    inline void XmlSerializer::write_compact(const XmlNode & node)
+    {
+        if (node.is_data())
+        {
+            escape(out, node.data.data(), node.data.size(), text_specials(), true);
+            return;
+        }
+
+        out.put('<');
+        out.write_ref(node.name.str());
+        for (XmlAttributesMap::const_iterator i = node.attributes.begin(); i != node.attributes.end(); ++i)
+        {
+            out.put(' ');
+            out.write_ref(i->first.str());
+            out.write("=\"", 2);
+            escape(out, i->second.data(), i->second.size(), attribute_specials(), true);
+            out.put('\"');
+        }
+
+        if (! node._first_child)
+        {
+            out.write("/>", 2);
+            return;
+        }
+
+        out.put('>');
+        for (const XmlNode * p = node._first_child; p; p = p->_next_sibling)
+            write_compact(* p);
+        out.write("</", 2);
+        out.write_ref(node.name.str());
+        out.put('>');
+    }
+
+    inline void XmlSerializer::write_pretty(const XmlNode & node, int indent, int shift)
+    {
+        if (node.is_data())
+        {
+            escape(out, node.data.data(), node.data.size(), all_specials(), true);
+            out.put('\n');
+            return;
+        }
+
+        write_indent(indent * shift);
+        out.put('<');
+        out.write_ref(node.name.str());
+        for (XmlAttributesMap::const_iterator i = node.attributes.begin(); i != node.attributes.end(); ++i)
+        {
+            out.put(' ');
+            out.write_ref(i->first.str());
+            out.write("=\"", 2);
+            escape(out, i->second.data(), i->second.size(), all_specials(), true);
+            out.put('\"');
+        }
+
+        if (! node._first_child)
+        {
+            out.write(" />\n", 4);
+            return;
+        }
+
+        out.write(">\n", 2);
+        for (const XmlNode * p = node._first_child; p; p = p->_next_sibling)
+            write_pretty(* p, indent + 1, shift);
+        write_indent(indent * shift);
+        out.write("</", 2);
+        out.write_ref(node.name.str());
+        out.write(">\n", 2);
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLSERIALIZER_H
@@ -0,0 +1,184 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef INCLUDED_ELL_IMPL_XMLSNAPSHOT_H
+#define INCLUDED_ELL_IMPL_XMLSNAPSHOT_H
+
+namespace ell
+{
+    inline uint32_t XmlSnapshotHeader::compute_checksum() const
+    {
+        XmlSnapshotHeader h = * this;
+        h.checksum = 0;
+        const unsigned char * p = (const unsigned char *) & h;
+        uint32_t c = 2166136261u;
+        for (size_t i = 0; i < sizeof h; ++i)
+            c = (c ^ p[i]) * 16777619u;
+        return c;
+    }
+
+    inline bool XmlSnapshot::stamp(const char * path, uint64_t & size, int64_t & mtime)
+    {
+        struct stat st;
+        if (stat(path, & st))
+            return false;
+        size = (uint64_t) st.st_size;
+#       if defined(__linux__)
+        mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#       else
+        mtime = (int64_t) st.st_mtime;
+#       endif
+        return true;
+    }
+
+    inline bool XmlSnapshot::save(const XmlTape & tape, const char * path, const char * source_path)
+    {
+        XmlSnapshotHeader h;
+        memset(& h, 0, sizeof h);
+        if (! stamp(source_path, h.source_size, h.source_mtime))
+            return false;
+
+        const XmlTape::Attribute * attributes = tape.attributes_begin(0);
+        memcpy(h.magic, "ELLTAPE", 8);
+        h.version = 1;
+        h.records = tape.size();
+        h.attributes = tape.attributes_end((uint32_t) tape.size() - 1) - attributes;
+        h.strings = tape.heap_size();
+        h.checksum = h.compute_checksum();
+
+        FILE * f = fopen(path, "wb");
+        if (! f)
+            return false;
+        bool ok = fwrite(& h, sizeof h, 1, f) == 1 &&
+                  fwrite(& tape.record(0), sizeof(XmlTape::Record), h.records, f) == h.records &&
+                  (! h.attributes || fwrite(attributes, sizeof(XmlTape::Attribute), h.attributes, f) == h.attributes) &&
+                  (! h.strings || fwrite(tape.heap, 1, h.strings, f) == h.strings);
+        ok = fclose(f) == 0 && ok;
+        if (! ok)
+            remove(path);
+        return ok;
+    }
+
+    inline bool XmlSnapshot::open(const char * path, const char * source_path)
+    {
+        close();
+
+        uint64_t source_size;
+        int64_t source_mtime;
+        if (! stamp(source_path, source_size, source_mtime))
+            return false;
+
+#       if ELL_XML_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void * m = MAP_FAILED;
+        if (! fstat(fd, & st) && (size_t) st.st_size >= sizeof(XmlSnapshotHeader))
+            m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED)
+            return false;
+        map = (const char *) m;
+        map_size = st.st_size;
+#       else
+        FILE * f = fopen(path, "rb");
+        if (! f)
+            return false;
+        char block[65536];
+        for (size_t n; (n = fread(block, 1, sizeof block, f)) != 0; )
+            buffer.insert(buffer.end(), block, block + n);
+        fclose(f);
+        if (buffer.size() < sizeof(XmlSnapshotHeader))
+        {
+            buffer.clear();
+            return false;
+        }
+        map = & buffer[0];
+        map_size = buffer.size();
+#       endif
+
+        const XmlSnapshotHeader & h = * (const XmlSnapshotHeader *) map;
+        const size_t rs = sizeof(XmlTape::Record), as = sizeof(XmlTape::Attribute);
+        if (memcmp(h.magic, "ELLTAPE", 8) || h.version != 1 || h.checksum != h.compute_checksum() ||
+            h.source_size != source_size || h.source_mtime != source_mtime ||
+            ! check(h, map + sizeof h, map_size - sizeof h))
+        {
+            close();
+            return false;
+        }
+
+        const char * p = map + sizeof h;
+        tape.attach((const XmlTape::Record *) p, h.records,
+                    (const XmlTape::Attribute *) (p + h.records * rs), h.attributes,
+                    p + h.records * rs + h.attributes * as);
+        return true;
+    }
+
+    inline bool XmlSnapshot::check(const XmlSnapshotHeader & h, const char * body, size_t size)
+    {
+        // Without overflow: each part is compared to what is left
+        const size_t rs = sizeof(XmlTape::Record), as = sizeof(XmlTape::Attribute);
+        if (h.records == 0 || h.records > XmlTape::npos || h.records > size / rs)
+            return false;
+        size -= h.records * rs;
+        if (h.attributes > XmlTape::npos || h.attributes > size / as)
+            return false;
+        size -= h.attributes * as;
+        if (h.strings != size)
+            return false;
+
+        const XmlTape::Record * records = (const XmlTape::Record *) body;
+        const XmlTape::Attribute * attributes = (const XmlTape::Attribute *) (body + h.records * rs);
+        const uint64_t n = h.records, npos = XmlTape::npos;
+
+        // Links follow the document order, so that walks end
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            const XmlTape::Record & r = records[i];
+            if ((i == 0) != (r.parent == npos) || (r.parent != npos && r.parent >= i) ||
+                (r.previous_sibling != npos && r.previous_sibling >= i) ||
+                (r.next_sibling != npos && (r.next_sibling <= i || r.next_sibling >= n)) ||
+                (r.last_child != npos && (r.last_child <= i || r.last_child >= n)) ||
+                r.attributes > (i + 1 < n ? records[i + 1].attributes : h.attributes) ||
+                (uint64_t) r.text.offset + r.text.size > h.strings)
+                return false;
+        }
+
+        for (uint64_t i = 0; i < h.attributes; ++i)
+        {
+            const XmlTape::Attribute & a = attributes[i];
+            if ((uint64_t) a.name.offset + a.name.size > h.strings ||
+                (uint64_t) a.value.offset + a.value.size > h.strings)
+                return false;
+        }
+        return true;
+    }
+
+    inline void XmlSnapshot::close()
+    {
+#       if ELL_XML_MMAP
+        if (map)
+            munmap((void *) map, map_size);
+#       endif
+        buffer.clear();
+        map = 0;
+        map_size = 0;
+        tape.clear();
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLSNAPSHOT_H
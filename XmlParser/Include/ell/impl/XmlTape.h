@@ -0,0 +1,402 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLTAPE_H
+#define INCLUDED_ELL_IMPL_XMLTAPE_H
+
+namespace ell
+{
+    inline void XmlTape::clear()
+    {
+        records.clear();
+        attributes.clear();
+        strings.clear();
+        heap = 0;
+
+        Record document = { npos, npos, npos, npos, 0, { 0, 0 }, 0 };
+        records.push_back(document);
+        publish();
+    }
+
+    inline size_t XmlTape::heap_size() const
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < record_count; ++i)
+            size = std::max(size, (size_t) record_data[i].text.offset + record_data[i].text.size);
+        for (size_t i = 0; i < attribute_count; ++i)
+        {
+            size = std::max(size, (size_t) attribute_data[i].name.offset + attribute_data[i].name.size);
+            size = std::max(size, (size_t) attribute_data[i].value.offset + attribute_data[i].value.size);
+        }
+        return size;
+    }
+
+    inline bool XmlTapeNode::is_element() const
+    {
+        return (tape->record(index).line & XmlTape::data_flag) == 0 &&
+               tape->record(index).text.size != 0;
+    }
+
+    inline int XmlTapeNode::line() const
+    {
+        return tape->record(index).line & ~ XmlTape::data_flag;
+    }
+
+    inline void XmlTapeNode::raise_error(const std::string & msg) const
+    {
+        std::ostringstream oss;
+        if (line())
+            oss << line() << ": ";
+        oss << msg << std::endl;
+        throw std::runtime_error(oss.str());
+    }
+
+    inline ell::string XmlTapeNode::get_attrib(const ell::string & attr_name) const
+    {
+        assert(is_element());
+        for (const XmlTape::Attribute * i = tape->attributes_begin(index), * end = tape->attributes_end(index);
+             i != end;
+             ++i)
+        {
+            if (tape->get_string(i->name) == attr_name)
+                return tape->get_string(i->value);
+        }
+        raise_error(describe() + ": no such attribute: " + attr_name);
+        return ell::string("");
+    }
+
+    template <typename T>
+    T XmlTapeNode::get_attrib(const ell::string & attr_name) const
+    {
+        T value;
+        ell::string s = get_attrib(attr_name);
+
+        if (! xml_convert(s.position, s.position + s.size(), value))
+            raise_error("Wrong type for attribute " + attr_name);
+        return value;
+    }
+
+    template <>
+    inline std::string XmlTapeNode::get_attrib<std::string>(const ell::string & attr_name) const
+    {
+        return get_attrib(attr_name).str();
+    }
+
+    inline bool XmlTapeNode::has_attrib(const ell::string & attr_name) const
+    {
+        assert(is_element());
+        for (const XmlTape::Attribute * i = tape->attributes_begin(index), * end = tape->attributes_end(index);
+             i != end;
+             ++i)
+        {
+            if (tape->get_string(i->name) == attr_name)
+                return true;
+        }
+        return false;
+    }
+
+    inline const XmlTapeNode & XmlTapeNode::check_attrib(const ell::string & attr_name, const ell::string & value) const
+    {
+        ell::string val = get_attrib(attr_name);
+        if (val != value)
+            raise_error(describe() + ": " +
+                        attr_name + "=\"" + val +
+                        "\", expecting \"" + value + "\"");
+        return * this;
+    }
+
+    inline ell::string XmlTapeNode::get_name() const
+    {
+        assert(is_element());
+        return tape->get_string(tape->record(index).text);
+    }
+
+    inline const XmlTapeNode & XmlTapeNode::check_name(const ell::string & n) const
+    {
+        if (n != get_name())
+            raise_error(describe() + ": expecting element " + n);
+        return * this;
+    }
+
+    inline ell::string XmlTapeNode::get_data() const
+    {
+        assert(is_data());
+        return tape->get_string(tape->record(index).text);
+    }
+
+    inline const XmlTapeNode & XmlTapeNode::check_data(const ell::string & d) const
+    {
+        if (d != get_data())
+            raise_error(describe() + ": value \"" + get_data() + "\", expecting \"" + d + "\"");
+        return * this;
+    }
+
+    inline void XmlTapeNode::get_text(std::string & s) const
+    {
+        s.clear();
+        const char * sep = "";
+        for (XmlTapeIterator i = first(); i; ++i)
+        {
+            if ((* i).is_data())
+            {
+                s += sep;
+                s += (* i).get_data();
+                sep = " ";
+            }
+        }
+    }
+
+    inline XmlTapeNode XmlTapeNode::next_sibling() const
+    {
+        uint32_t i = tape->record(index).next_sibling;
+        if (i == XmlTape::npos)
+            raise_error(describe() + ": no next sibling");
+        return XmlTapeNode(tape, i);
+    }
+
+    inline XmlTapeNode XmlTapeNode::previous_sibling() const
+    {
+        uint32_t i = tape->record(index).previous_sibling;
+        if (i == XmlTape::npos)
+            raise_error(describe() + ": no previous sibling");
+        return XmlTapeNode(tape, i);
+    }
+
+    inline XmlTapeNode XmlTapeNode::first_child() const
+    {
+        if (tape->record(index).last_child == XmlTape::npos)
+            raise_error(describe() + ": no child");
+        return XmlTapeNode(tape, index + 1);
+    }
+
+    inline XmlTapeNode XmlTapeNode::last_child() const
+    {
+        uint32_t i = tape->record(index).last_child;
+        if (i == XmlTape::npos)
+            raise_error(describe() + ": no child");
+        return XmlTapeNode(tape, i);
+    }
+
+    inline XmlTapeNode XmlTapeNode::parent() const
+    {
+        uint32_t i = tape->record(index).parent;
+        if (i == XmlTape::npos)
+            raise_error(describe() + ": no parent");
+        return XmlTapeNode(tape, i);
+    }
+
+    inline XmlTapeIterator XmlTapeNode::first() const
+    {
+        if (tape->record(index).last_child == XmlTape::npos)
+            return XmlTapeIterator(tape);
+        return XmlTapeIterator(tape, index + 1);
+    }
+
+    inline XmlTapeIterator XmlTapeNode::last() const
+    {
+        return XmlTapeIterator(tape, tape->record(index).last_child);
+    }
+
+    inline void XmlTapeNode::unparse(std::ostream & os, int indent, int shift) const
+    {
+        XmlStreamOutput out(os);
+        XmlSerializer serializer(out);
+        write_pretty(serializer, indent, shift);
+    }
+
+    inline void XmlTapeNode::write_pretty(XmlSerializer & serializer, int indent, int shift) const
+    {
+        XmlOutput & out = serializer.out;
+        if (is_data())
+        {
+            ell::string data = get_data();
+            serializer.write_text(data.position, data.size(), true);
+            out.put('\n');
+            return;
+        }
+
+        serializer.write_indent(indent * shift);
+        out.put('<');
+        out.write(get_name());
+        for (const XmlTape::Attribute * i = tape->attributes_begin(index), * end = tape->attributes_end(index);
+             i != end;
+             ++i)
+        {
+            out.put(' ');
+            out.write(tape->get_string(i->name));
+            out.write("=\"", 2);
+            ell::string value = tape->get_string(i->value);
+            serializer.write_attribute_value(value.position, value.size(), true);
+            out.put('\"');
+        }
+
+        if (! first())
+        {
+            out.write(" />\n", 4);
+            return;
+        }
+
+        out.write(">\n", 2);
+        for (XmlTapeIterator i = first(); i; ++i)
+            (* i).write_pretty(serializer, indent + 1, shift);
+        serializer.write_indent(indent * shift);
+        out.write("</", 2);
+        out.write(get_name());
+        out.write(">\n", 2);
+    }
+
+    inline void XmlTapeNode::dump(std::ostream & out, int indent, int shift) const
+    {
+        std::string indent_str(indent * shift, ' ');
+        out << indent_str << describe() << std::endl;
+        for (XmlTapeIterator i = first(); i; ++i)
+        {
+            (* i).dump(out, indent + 1, shift);
+        }
+    }
+
+    inline std::string XmlTapeNode::describe() const
+    {
+        std::ostringstream oss;
+        if (line())
+            oss << line() << ": ";
+        if (is_element())
+        {
+            oss << "Element `" << get_name() << "`";
+            for (const XmlTape::Attribute * i = tape->attributes_begin(index), * end = tape->attributes_end(index);
+                 i != end;
+                 ++i)
+            {
+                oss << " " << tape->get_string(i->name) << "=" << tape->get_string(i->value);
+            }
+        }
+        else
+            oss << "Data \"" + protect(get_data().str()) + "\"";
+        return oss.str();
+    }
+
+    inline XmlTapeNode XmlTapeIterator::operator * () const
+    {
+        return XmlTapeNode(tape, current);
+    }
+
+    inline XmlTapeIterator & XmlTapeIterator::operator ++ ()
+    {
+        current = tape->record(current).next_sibling;
+        return * this;
+    }
+
+    inline XmlTapeIterator & XmlTapeIterator::operator -- ()
+    {
+        current = tape->record(current).previous_sibling;
+        return * this;
+    }
+
+    inline XmlTapeIterator XmlTapeIterator::operator ++ (int)
+    {
+        XmlTapeIterator it(* this);
+        ++(* this);
+        return it;
+    }
+
+    inline XmlTapeIterator XmlTapeIterator::operator -- (int)
+    {
+        XmlTapeIterator it(* this);
+        --(* this);
+        return it;
+    }
+
+    inline XmlTapeIterator XmlTapeIterator::operator + (int inc) const
+    {
+        XmlTapeIterator it(* this);
+        for (int i = 0; i < inc; i++)
+            ++it;
+        return it;
+    }
+
+    inline XmlTapeIterator XmlTapeIterator::operator - (int dec) const
+    {
+        XmlTapeIterator it(* this);
+        for (int i = 0; i < dec; i++)
+            --it;
+        return it;
+    }
+
+    inline XmlTape::String XmlTapeParser::store(const char * s, size_t size)
+    {
+        size_t offset = is_insitu() ? (size_t) (s - tape.heap) : tape.strings.size();
+        if (offset > XmlTape::npos || size > XmlTape::npos - offset)
+            raise_error("Document too large for a tape: strings beyond 4 GiB", line_number);
+
+        XmlTape::String r;
+        r.offset = (uint32_t) offset;
+        r.size = (uint32_t) size;
+        if (! is_insitu())
+            tape.strings.insert(tape.strings.end(), s, s + size);
+        return r;
+    }
+
+    inline uint32_t XmlTapeParser::append(const XmlTape::String & text, bool element)
+    {
+        // npos is not a valid index
+        if (tape.records.size() >= XmlTape::npos || tape.attributes.size() >= XmlTape::npos)
+            raise_error("Document too large for a tape: too many nodes or attributes", line_number);
+
+        uint32_t i = (uint32_t) tape.records.size();
+        XmlTape::Record & parent = tape.records[current];
+
+        XmlTape::Record r;
+        r.parent = current;
+        r.previous_sibling = parent.last_child;
+        r.next_sibling = XmlTape::npos;
+        r.last_child = XmlTape::npos;
+        r.attributes = (uint32_t) tape.attributes.size();
+        r.text = text;
+        r.line = element ? line_number : line_number | XmlTape::data_flag;
+
+        if (parent.last_child != XmlTape::npos)
+            tape.records[parent.last_child].next_sibling = i;
+        parent.last_child = i;
+
+        tape.records.push_back(r);
+        return i;
+    }
+
+    inline void XmlTapeParser::on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
+    {
+        ELL_DUMP("Append element `" + name + '`');
+        current = append(store(name.position, name.size()), true);
+        for (XmlAttributeViews::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            XmlTape::Attribute a;
+            a.name = store(i->first.position, i->first.size());
+            a.value = store(i->second.position, i->second.size());
+            tape.attributes.push_back(a);
+        }
+    }
+
+    inline void XmlTapeParser::on_end_element(const ell::string &)
+    {
+        current = tape.records[current].parent;
+    }
+
+    inline void XmlTapeParser::on_data_view(const ell::string & data)
+    {
+        ELL_DUMP("Append data `" + data + '`');
+        append(store(data.position, data.size()), false);
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLTAPE_H
@@ -0,0 +1,114 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INCLUDED_ELL_IMPL_XMLWRITER_H
+#define INCLUDED_ELL_IMPL_XMLWRITER_H
+
+namespace ell
+{
+    inline void XmlWriter::close_tag()
+    {
+        if (tag_open)
+        {
+            if (pretty)
+                serializer.out.write(">\n", 2);
+            else
+                serializer.out.put('>');
+            tag_open = false;
+        }
+    }
+
+    inline XmlWriter & XmlWriter::start_element(const ell::string & name)
+    {
+        close_tag();
+        if (pretty)
+            serializer.write_indent(depth() * shift);
+        serializer.out.put('<');
+        serializer.out.write(name);
+
+        offsets.push_back(names.size());
+        names.append(name.position, name.size());
+        tag_open = true;
+        return * this;
+    }
+
+    inline XmlWriter & XmlWriter::attribute(const ell::string & name, const ell::string & value)
+    {
+        if (! tag_open)
+            throw std::runtime_error("Attribute `" + name + "` outside of a start tag");
+
+        XmlOutput & out = serializer.out;
+        out.put(' ');
+        out.write(name);
+        out.write("=\"", 2);
+        serializer.write_attribute_value(value.position, value.size(), true);
+        out.put('\"');
+        return * this;
+    }
+
+    inline XmlWriter & XmlWriter::text(const ell::string & data)
+    {
+        if (offsets.empty())
+            throw std::runtime_error("Text outside of any element");
+
+        close_tag();
+        serializer.write_text(data.position, data.size(), true);
+        if (pretty)
+            serializer.out.put('\n');
+        return * this;
+    }
+
+    inline XmlWriter & XmlWriter::end_element()
+    {
+        if (offsets.empty())
+            throw std::runtime_error("End of element without any opened one");
+
+        XmlOutput & out = serializer.out;
+        size_t offset = offsets.back();
+        offsets.pop_back();
+
+        if (tag_open)
+        {
+            if (pretty)
+                out.write(" />\n", 4);
+            else
+                out.write("/>", 2);
+            tag_open = false;
+        }
+        else
+        {
+            if (pretty)
+                serializer.write_indent(depth() * shift);
+            out.write("</", 2);
+            out.write(names.data() + offset, names.size() - offset);
+            if (pretty)
+                out.write(">\n", 2);
+            else
+                out.put('>');
+        }
+
+        names.resize(offset);
+        return * this;
+    }
+
+    inline void XmlWriter::finish()
+    {
+        if (! offsets.empty())
+            throw std::runtime_error("Unclosed element: `" + names.substr(offsets.back()) + "`");
+        serializer.out.flush();
+    }
+}
+
+#endif // INCLUDED_ELL_IMPL_XMLWRITER_H
@@ -0,0 +1,92 @@
+// This file is part of Ell library.
+//
+// Ell library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Ell library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ell library.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <ctime>
+#include <iostream>
+#include <string>
+
+#include <ell/XmlParser.h>
+
+using namespace ell;
+
+/// Parsing throughput on documents stressing text scanning
+/// Times should grow linearly with the padding.
+
+namespace
+{
+    /// Elements nested `depth` levels deep, indented by `pad` blanks per level
+    std::string indented(int depth, int pad, int count)
+    {
+        std::string s = "<root>\n";
+        for (int n = 0; n < count; ++n)
+        {
+            for (int i = 1; i <= depth; ++i)
+                s += std::string(i * pad, ' ') + "<e>\n";
+            s += std::string((depth + 1) * pad, ' ') + "text\n";
+            for (int i = depth; i >= 1; --i)
+                s += std::string(i * pad, ' ') + "</e>\n";
+        }
+        return s + "</root>";
+    }
+
+    /// Texts made of words separated by `pad` blanks, with trailing blanks
+    std::string padded(int pad, int count)
+    {
+        std::string blanks(pad, ' '), s = "<root>";
+        for (int n = 0; n < count; ++n)
+            s += "<p>word" + blanks + "word &amp; word" + blanks + "</p>";
+        return s + "</root>";
+    }
+
+    void bench(XmlGrammar & g, const char * title, const std::string & input, bool index)
+    {
+        XmlDomParser p(g);
+        p.set_structural_index(index);
+
+        const int repeat = 10;
+        clock_t start = clock();
+        for (int i = 0; i < repeat; ++i)
+            p.parse(input.c_str());
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+        std::cout << title << (index ? " (indexed)" : "") << ": "
+                  << input.size() / 1024 << " KiB, "
+                  << input.size() * repeat / (seconds * 1024 * 1024 + 1e-9) << " MiB/s\n";
+    }
+}
+
+int main()
+{
+    XmlGrammar g;
+    const int pads[] = { 4, 64, 1024 };
+
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string doc = indented(8, pads[i], 4096 / pads[i]);
+        std::cout << "Indentation " << pads[i] << '\n';
+        bench(g, "  indented", doc, false);
+        bench(g, "  indented", doc, true);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string doc = padded(pads[i], 65536 / pads[i]);
+        std::cout << "Padding " << pads[i] << '\n';
+        bench(g, "  padded", doc, false);
+        bench(g, "  padded", doc, true);
+    }
+    return 0;
+}
@@ -15,15 +15,306 @@
 
 #include <fstream>
 #include <iostream>
+#include <cstddef>
 #include <cstdlib>
 
+#include <ell/XmlBinding.h>
+#include <ell/XmlDiff.h>
+#include <ell/XmlFrozen.h>
+#include <ell/XmlParallel.h>
 #include <ell/XmlParser.h>
+#include <ell/XmlTape.h>
+#include <ell/XmlQuery.h>
+#include <ell/XmlReader.h>
+#include <ell/XmlSchema.h>
+#include <ell/XmlSnapshot.h>
+#include <ell/XmlWriter.h>
 
 using namespace ell;
 
 #define DUMP(f, ...) fprintf(stderr, f "\n" , ## __VA_ARGS__)
 #define ERROR(f, ...) do { DUMP(f , ## __VA_ARGS__); abort(); } while(0)
 
+/// Compare a compact DOM with a node based one
+bool is_equal(const XmlTapeNode & t, const XmlNode & n)
+{
+    if (t.is_element() != n.is_element())
+        return false;
+
+    if (n.is_data())
+        return t.get_data() == n.data;
+
+    if (t.get_name() != n.name)
+        return false;
+
+    for (XmlAttributesMap::const_iterator i = n.attributes.begin(); i != n.attributes.end(); ++i)
+    {
+        if (! t.has_attrib(i->first.str()) || t.get_attrib(i->first.str()) != i->second)
+            return false;
+    }
+
+    XmlTapeIterator ti = t.first();
+    for (XmlNode * child = n._first_child; child; child = child->_next_sibling, ++ti)
+    {
+        if (! ti || ! is_equal(* ti, * child))
+            return false;
+    }
+
+    return ! ti;
+}
+
+/// Compare DOMs including positions
+bool same_positions(const XmlNode & a, const XmlNode & b)
+{
+    if (a.line != b.line || a.source_begin != b.source_begin || a.source_end != b.source_end)
+        return false;
+
+    const XmlNode * i = a._first_child, * j = b._first_child;
+    for (; i && j; i = i->_next_sibling, j = j->_next_sibling)
+    {
+        if (! same_positions(* i, * j))
+            return false;
+    }
+    return ! i && ! j;
+}
+
+/// Record parser summing prices, and keeping the last record
+struct RecordSum : public XmlDomParser
+{
+    RecordSum(XmlGrammar & g)
+      : XmlDomParser(g), count(0), sum(0), kept(0)
+    { }
+
+    ~RecordSum() { delete kept; }
+
+    bool on_record(XmlNode * record)
+    {
+        ++count;
+        int price;
+        record->check_name("r")->first_child()->check_name("price")->first_child()->get_data(price);
+        sum += price;
+        delete kept;
+        kept = record;
+        return true;
+    }
+
+    int count, sum;
+    XmlNode * kept;
+};
+
+/// SAX consumer checking that strings are slices of the input when possible
+struct ViewChecker : public XmlParser
+{
+    ViewChecker(XmlGrammar & g, const char * input)
+      : XmlParser(g), begin(input), end(input + strlen(input)), slices(0), decoded(0)
+    { }
+
+    void check(const ell::string & s)
+    {
+        if (s.position >= begin && s.position + s.size() <= end)
+            ++slices;
+        else
+            ++decoded;
+    }
+
+    void on_start_element(const ell::string & name, const XmlAttributeViews & attrs)
+    {
+        check(name);
+        for (XmlAttributeViews::const_iterator i = attrs.begin(); i != attrs.end(); ++i)
+        {
+            check(i->first);
+            check(i->second);
+        }
+    }
+
+    void on_end_element(const ell::string & name) { check(name); }
+    void on_data_view(const ell::string & data) { check(data); }
+
+    const char * begin, * end;
+    int slices, decoded;
+};
+
+/// Reader of a frozen document, checking that the versions it sees are consistent
+struct FrozenReader
+{
+    FrozenReader(const XmlFrozenDocument & document)
+      : document(document), reads(0), errors(0)
+    { }
+
+    void run()
+    {
+        for (int last = 0; last < 100; ++reads)
+        {
+            XmlFrozenRef r = document.acquire();
+            int n = r->get_attrib<int>("n");
+            if (n < last || (int) r->child_count() != n + 1 || r->child_at(n)->get_attrib<int>("i") != n)
+                ++errors;
+            last = n;
+        }
+    }
+
+    const XmlFrozenDocument & document;
+    int reads, errors;
+};
+
+/// Random access to the children of a shared DOM
+struct IndexReader
+{
+    IndexReader(const XmlNode * root = 0)
+      : root(root), errors(0)
+    { }
+
+    void run() { check(root); }
+
+    void check(const XmlNode * node)
+    {
+        XmlNodeRange r = node->children();
+        if (r.size() != node->child_count())
+            ++errors;
+        for (size_t i = 0; i < r.size(); ++i)
+        {
+            if (node->child_at(i) != r[i] || r[i]->index_in_parent() != i)
+                ++errors;
+            check(r[i]);
+        }
+    }
+
+    const XmlNode * root;
+    int errors;
+};
+
+/// First uses of the HTML entity table, racing to build it
+struct EntityFinder
+{
+    EntityFinder()
+      : errors(0)
+    { }
+
+    void run()
+    {
+        const std::string * e = XmlEntityTable::html().find("eacute", 6);
+        if (! e || * e != "\xC3\xA9" || XmlEntityTable::html().size() != 252)
+            ++errors;
+    }
+
+    int errors;
+};
+
+/// Iterator arithmetic on a shared DOM without child index
+struct SiblingStepper
+{
+    SiblingStepper(XmlNode * root = 0)
+      : root(root), errors(0)
+    { }
+
+    void run()
+    {
+        int k = 0;
+        for (XmlNode * c = root->first_child(); c; c = c->_next_sibling, ++k)
+        {
+            if (* (root->first() + k) != c || * (root->last() - (int) (root->_last_child->line - c->line)) != c)
+                ++errors;
+        }
+    }
+
+    XmlNode * root;
+    int errors;
+};
+
+/// Intern names in the default table, shared by threads
+struct DefaultNamer
+{
+    DefaultNamer(int seed = 0)
+      : seed(seed), errors(0)
+    { }
+
+    void run()
+    {
+        XmlNameTable & table = XmlNameTable::default_table();
+        for (int i = 0; i < 500; ++i)
+        {
+            std::ostringstream oss;
+            oss << "p" << i % 7 << ":n" << (i + seed) % 100;
+            std::string s = oss.str();
+            XmlName n(s);
+            if (n.str() != s || n.table() != & table || table.find(s) != n ||
+                n.local().str() != s.substr(s.find(':') + 1) || table[n.id()] != n)
+                ++errors;
+        }
+    }
+
+    int seed, errors;
+};
+
+/// Thaw a shared frozen tree in its own name table
+struct FrozenThawer
+{
+    FrozenThawer(const XmlFrozenRef & root, const std::string & expected)
+      : root(root), expected(expected), errors(0)
+    { }
+
+    void run()
+    {
+        for (int k = 0; k < 50; ++k)
+        {
+            XmlNameTable names;
+            XmlNode * n = root->thaw(names);
+            std::ostringstream oss;
+            n->unparse(oss);
+            if (oss.str() != expected || n->name.table() != & names ||
+                n->first_child()->first_child()->name.table() != & names)
+                ++errors;
+            delete n;
+        }
+    }
+
+    XmlFrozenRef root;
+    std::string expected;
+    int errors;
+};
+
+/// Parallel visitor listing start and end tags, an order dependent reduction
+struct NameLister : public XmlParallelVisitor<std::string>
+{
+    NameLister(size_t workers, size_t threshold)
+      : XmlParallelVisitor<std::string>(workers, threshold)
+    { }
+
+    void enterNode(const XmlNode * node, std::string & names)
+    {
+        if (node->is_element())
+        {
+            if (node->get_name() == "bad")
+                node->raise_error("Bad element");
+            names += node->get_name() + ' ';
+        }
+    }
+
+    void leaveNode(const XmlNode * node, std::string & names)
+    {
+        if (node->is_element())
+            names += '/' + node->get_name() + ' ';
+    }
+
+    void reduce(std::string & into, const std::string & from) { into += from; }
+};
+
+struct Point
+{
+    int x, y;
+};
+
+struct Shape
+{
+    Shape() : closed(false) { }
+
+    std::string name, color, comment;
+    bool closed;
+    Point origin;
+    std::vector<Point> points;
+    std::vector<double> weights;
+};
+
 void nonreg()
 {
     struct Vector
@@ -41,7 +332,9 @@ void nonreg()
         {3, "<not open=\"error\"></not></hum>", false},
         {4, "   <white>  space 2 \r\n  </white> \r\n  \t<top /> ", true},
         {5, "<entities inside_att=\"&quot;'&lt;'\\\"><![CDATA[]]&gt;<>\"]]>&lt;a&gt;</entities>", true},
-        {6, "<special\x00e9 char_in_ident_\x00e9=\"\x00e9\"></special\x00e9>", true}
+        {6, "<special\x00e9 char_in_ident_\x00e9=\"\x00e9\"></special\x00e9>", true},
+        {7, "<unknown>&nbsp;</unknown>", false},
+        {8, "<invalid>&#xD800;</invalid>", false}
     };
 
     try
@@ -101,6 +394,62 @@ void nonreg()
                 }
                 else
                     DUMP("Ok.");
+
+                DUMP("Compare in-situ parsing DOM with first one");
+                std::vector<char> buffer(v->value, v->value + strlen(v->value) + 1);
+                XmlDomParser p3(g);
+                ELL_ENABLE_DUMP(p3);
+
+                try
+                {
+                    p3.parse_insitu(& buffer[0]);
+                }
+                catch (std::runtime_error & e)
+                {
+                    ERROR("Unexpected failure: %s", e.what());
+                }
+
+                if (! root1->is_equal(* p3.get_root()))
+                {
+                    DUMP("\nIn-situ DOM:");
+                    p3.get_root()->dump(std::cout);
+                    ERROR("DOMs are differents");
+                }
+                else
+                    DUMP("Ok.");
+
+                DUMP("Compare compact DOMs with first one");
+                XmlTapeParser p4(g);
+                ELL_ENABLE_DUMP(p4);
+                buffer.assign(v->value, v->value + strlen(v->value) + 1);
+
+                try
+                {
+                    p4.parse(v->value);
+                    if (! is_equal(p4.get_root(), * root1))
+                    {
+                        p4.get_root().dump(std::cout);
+                        ERROR("DOMs are differents");
+                    }
+
+                    std::ostringstream tape_output, dom_output;
+                    p4.get_root().unparse(tape_output, 1, 2);
+                    root1->unparse(dom_output, 1, 2);
+                    if (tape_output.str() != dom_output.str())
+                        ERROR("Wrong compact DOM output: %s", tape_output.str().c_str());
+
+                    p4.parse_insitu(& buffer[0]);
+                    if (! is_equal(p4.get_root(), * root1))
+                    {
+                        p4.get_root().dump(std::cout);
+                        ERROR("In-situ DOMs are differents");
+                    }
+                }
+                catch (std::runtime_error & e)
+                {
+                    ERROR("Unexpected failure: %s", e.what());
+                }
+                DUMP("Ok.");
             }
         }
 
@@ -172,6 +521,1241 @@ void nonreg()
                 std::cout << ** i;
             }
         }
+
+        // Test attribute storage
+        {
+            DUMP("Check attributes");
+            XmlGrammar g;
+            XmlDomParser p(g);
+
+            p.parse("<a z=\"1\" y=\"&lt;2&gt;\" x=\"\" w=\"4\" v=\"5\" u=\"6\" t=\"7\" s=\"8\" r=\"9\" q=\"10\" />");
+            XmlNode * root = p.get_root();
+            if (root->attributes.size() != 10 ||
+                root->get_attrib("y") != "<2>" ||
+                root->get_attrib("x") != "" ||
+                root->get_attrib<int>("q") != 10)
+                ERROR("Wrong attributes");
+
+            root->remove_attrib("z");
+            root->set_attrib("z", 11);
+            if (root->attributes.begin()->first != "y" ||
+                (root->attributes.end() - 1)->first != "z" ||
+                root->get_attrib("z") != "11")
+                ERROR("Wrong attribute order");
+            DUMP("Ok.");
+        }
+
+        // Test name interning
+        {
+            DUMP("Check name interning");
+            XmlGrammar g;
+            XmlNameTable names;
+            XmlDomParser p1(g, & names), p2(g, & names), p3(g);
+
+            const char * input = "<a x=\"1\"><b x=\"2\" /><c /><b /></a>";
+            p1.parse(input);
+            p2.parse(input);
+            p3.parse(input);
+            if (names.size() != 4 || & p3.names != & XmlNameTable::default_table() ||
+                p3.get_root()->name.table() != & p3.names)
+                ERROR("Wrong name count");
+
+            XmlName b = names.find("b");
+            if (b.id() != 3 || names[3] != b || names.find("d") != XmlName())
+                ERROR("Wrong name lookup");
+
+            int count = 0;
+            for (XmlIterator i = p1.get_root()->first(); i; ++i)
+            {
+                if ((* i)->name == b)
+                    ++count;
+            }
+            if (count != 2)
+                ERROR("Wrong name comparison");
+
+            XmlNode * c = p2.get_root()->first_child()->next_sibling();
+            c->check_name(names.find("c"));
+            c->set_attrib("y", "3");
+            if (c->attributes.begin()->first.table() != & names ||
+                p3.get_root()->first_child()->name != b ||
+                ! p1.get_root()->is_equal(* p3.get_root()))
+                ERROR("Wrong name table");
+
+            // Names of the default table outlive the parser
+            XmlNode * kept;
+            {
+                XmlDomParser p4(g);
+                p4.parse(input);
+                kept = p4.get_root()->detach();
+            }
+            if (kept->get_name() != "a" || kept->first_child()->attributes.begin()->first != "x" ||
+                kept->first_child()->name != p3.get_root()->first_child()->name)
+                ERROR("Wrong names after the parser");
+            delete kept;
+
+            // The default table is locked
+            std::vector<DefaultNamer> namers;
+            for (int i = 0; i < 4; ++i)
+                namers.push_back(DefaultNamer(i * 30));
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < namers.size(); ++i)
+                threads.push_back(std::thread(& DefaultNamer::run, & namers[i]));
+            for (size_t i = 0; i < threads.size(); ++i)
+                threads[i].join();
+            for (size_t i = 0; i < namers.size(); ++i)
+            {
+                if (namers[i].errors)
+                    ERROR("Wrong concurrent interning");
+            }
+            DUMP("Ok.");
+        }
+
+        // Test queries
+        {
+            DUMP("Check queries");
+            XmlGrammar g;
+            XmlDomParser p(g);
+
+            p.parse("<lib><book id=\"b1\" lang=\"en\"><title>A</title><title>A2</title></book>"
+                    "<shelf><book id=\"b2\" lang=\"fr\"><title>B</title></book>"
+                    "<book id=\"b3\" lang=\"en\"><title>C</title></book></shelf></lib>");
+            XmlIndex index(& p.document);
+
+            struct Check
+            {
+                const char * path;
+                const char * expected;
+            };
+
+            Check checks[] =
+            {
+                {"/lib/book/title", "A A2"},
+                {"//book[@lang='en']/title[1]", "A C"},
+                {"//title[last()]", "A2 B C"},
+                {"//book[2]/title", "C"},
+                {"/lib/*[2]//title", "B C"},
+                {"//book[@id]//text()", "A A2 B C"},
+                {"lib/shelf/book[@lang=\"fr\"][1]/title", "B"},
+                {"//book[3]", ""}
+            };
+
+            for (unsigned int i = 0; i < sizeof(checks) / sizeof(Check); i++)
+            {
+                std::vector<XmlNode *> r = index.select(checks[i].path);
+                std::string text, sep;
+                for (std::vector<XmlNode *>::const_iterator n = r.begin(); n != r.end(); ++n, sep = " ")
+                {
+                    std::string s;
+                    if ((* n)->is_data())
+                        s = (* n)->data;
+                    else
+                        (* n)->get_text(s);
+                    text += sep + s;
+                }
+                if (text != checks[i].expected)
+                    ERROR("%s: got \"%s\"", checks[i].path, text.c_str());
+            }
+
+            XmlNode * shelf = index.select_first("/lib/shelf");
+            if (index.element_by_id("b3") != index.select_first("book[2]", shelf) ||
+                index.children(shelf).size() != 2 ||
+                index.children(shelf)[1] != index.element_by_id("b3") ||
+                index.elements_named("title").size() != 4 ||
+                index.element_by_id("b4"))
+                ERROR("Wrong index");
+
+            try
+            {
+                index.select("/lib[");
+                ERROR("Invalid query accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Query error caught: %s", e.what());
+            }
+            DUMP("Ok.");
+        }
+
+        // Test pull parsing
+        {
+            DUMP("Check pull parsing");
+            XmlGrammar g;
+            XmlReader r(g);
+
+            const char * input = "<a x=\"1\"><!-- c --><b y=\"&lt;\"/>t &amp; u<skip><c>'>'</c><d a=\"/>\"/><![CDATA[</skip>]]></skip><e>v</e></a>";
+            std::string trace;
+            r.open(input);
+            for (XmlReader::Event e; (e = r.next()) != XmlReader::END_DOCUMENT; )
+            {
+                if (e == XmlReader::START_ELEMENT)
+                {
+                    trace += "<" + r.get_name();
+                    for (XmlAttributeViews::const_iterator i = r.get_attributes().begin(); i != r.get_attributes().end(); ++i)
+                        trace += " " + i->first + "=" + i->second;
+                    trace += ">";
+                    if (r.get_name() == "skip")
+                        r.skip_element();
+                }
+                if (r.get_event() == XmlReader::END_ELEMENT)
+                    trace += "</" + r.get_name() + ">";
+                else if (e == XmlReader::TEXT)
+                    trace += "[" + r.get_text() + "]";
+            }
+
+            if (trace != "<a x=1><b y=<></b>[t & u]<skip></skip><e>[v]</e></a>")
+                ERROR("Wrong events: %s", trace.c_str());
+
+            r.open("<a><b></a>");
+            try
+            {
+                while (r.next() != XmlReader::END_DOCUMENT)
+                    ;
+                ERROR("Bad nesting accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Parser error caught: %s", e.what());
+            }
+
+            // Stop early
+            r.open("<a><b>never parsed");
+            if (r.next() != XmlReader::START_ELEMENT || r.depth() != 1)
+                ERROR("Wrong first event");
+            DUMP("Ok.");
+        }
+
+        // Test serialization
+        {
+            DUMP("Check serialization");
+            XmlGrammar g;
+            XmlDomParser p(g);
+
+            p.parse("<a x=\"&quot;'&lt;&gt;\"><b/>text &amp; &quot;more&quot; in a long enough text node<c>1</c></a>");
+            XmlOutput out;
+            XmlSerializer(out).write_compact(* p.get_root());
+            if (out.str() != "<a x=\"&quot;'&lt;>\"><b/>text &amp; \"more\" in a long enough text node<c>1</c></a>")
+                ERROR("Wrong compact output: %s", out.str().c_str());
+
+            std::ostringstream oss;
+            p.get_root()->unparse(oss, 1, 2);
+            out.clear();
+            XmlSerializer(out).write_pretty(* p.get_root(), 1, 2);
+            if (out.str() != oss.str() ||
+                oss.str() != "  <a x=\"&quot;&apos;&lt;&gt;\">\n    <b />\ntext &amp; &quot;more&quot; in a long enough text node\n    <c>\n1\n    </c>\n  </a>\n")
+                ERROR("Wrong pretty output: %s", out.str().c_str());
+
+#if ELL_XML_WRITEV
+            FILE * f = tmpfile();
+            {
+                // Small buffer and threshold to mix copied and referenced strings
+                XmlFdOutput fd_out(fileno(f), 16, 8);
+                XmlSerializer(fd_out).write_compact(* p.get_root());
+            }
+            rewind(f);
+            char buffer[256];
+            size_t n = fread(buffer, 1, sizeof(buffer), f);
+            fclose(f);
+            out.clear();
+            XmlSerializer(out).write_compact(* p.get_root());
+            if (std::string(buffer, n) != out.str())
+                ERROR("Wrong file output: %s", std::string(buffer, n).c_str());
+
+            // Large writes are copies: the caller may reuse its buffer
+            f = tmpfile();
+            {
+                XmlFdOutput fd_out(fileno(f), 16, 8);
+                std::string reused(20, 'a');
+                fd_out.write(reused);
+                reused.assign(10, 'b');
+                fd_out.write(reused);
+                reused.assign(10, 'c');
+                fd_out.write_ref("0123456789", 10);
+                fd_out.write(reused);
+            }
+            rewind(f);
+            n = fread(buffer, 1, sizeof(buffer), f);
+            fclose(f);
+            if (std::string(buffer, n) != std::string(20, 'a') + std::string(10, 'b') + "0123456789" + std::string(10, 'c'))
+                ERROR("Wrong file output: %s", std::string(buffer, n).c_str());
+#endif
+            DUMP("Ok.");
+        }
+
+        // Test streaming writer
+        {
+            DUMP("Check streaming writer");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.parse("<a x=\"&lt;1&gt;\"><b /><c y=\"'\">t &amp; u</c></a>");
+
+            for (int pretty = 0; pretty < 2; ++pretty)
+            {
+                XmlOutput out;
+                XmlWriter w(out, pretty != 0, 3);
+                w.start_element("a").attribute("x", "<1>")
+                     .start_element("b").end_element()
+                     .start_element("c").attribute("y", "'").text("t & u").end_element()
+                 .end_element();
+                w.finish();
+
+                std::ostringstream oss;
+                p.get_root()->unparse(oss, 0, 3);
+                if (out.str() != (pretty ? oss.str() : "<a x=\"&lt;1&gt;\"><b/><c y=\"&apos;\">t &amp; u</c></a>"))
+                    ERROR("Wrong output: %s", out.str().c_str());
+            }
+
+            XmlOutput out;
+            XmlWriter w(out);
+            try
+            {
+                w.start_element("a").text("t").attribute("x", "1");
+                ERROR("Late attribute accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Writer error caught: %s", e.what());
+            }
+
+#if ELL_XML_WRITEV
+            {
+                // A zero-copy output must not keep the reused buffers
+                FILE * f = tmpfile();
+                std::string expected = "<" + std::string(5000, 'e') + ">";
+                {
+                    XmlFdOutput fd_out(fileno(f), 4096, 64);
+                    XmlWriter w(fd_out);
+                    std::string reused(5000, 'e');
+                    w.start_element(reused);
+                    for (char c = 'x'; c <= 'z'; ++c)
+                    {
+                        reused.assign(5000, c);
+                        w.start_element("t").attribute("v", reused).text(reused).end_element();
+                        expected += "<t v=\"" + reused + "\">" + reused + "</t>";
+                    }
+                    w.end_element();
+                    reused.assign(5000, '_');
+                    w.finish();
+                }
+                expected += "</" + std::string(5000, 'e') + ">";
+
+                rewind(f);
+                std::vector<char> buffer(expected.size() + 1);
+                size_t n = fread(& buffer[0], 1, buffer.size(), f);
+                fclose(f);
+                if (std::string(& buffer[0], n) != expected)
+                    ERROR("Wrong file output of the writer");
+            }
+#endif
+            DUMP("Ok.");
+        }
+
+        // Test filtered DOM
+        {
+            DUMP("Check filtered DOM");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.add_filter("/feed/entry/price");
+            p.add_filter("/feed/*/id");
+
+            p.parse("<feed>title<meta><id>0</id><x a=\"'>'\"/></meta>\n"
+                    "<entry><id>1</id><price cur=\"eur\">10<c/></price><junk><price>0</price></junk></entry>\n"
+                    "<other><![CDATA[<entry>]]><!-- <x> --></other>\n"
+                    "<entry k=\"2\"><price>20</price><x/></entry></feed>");
+
+            XmlOutput out;
+            XmlSerializer(out).write_compact(* p.get_root());
+            if (out.str() != "<feed><meta><id>0</id></meta><entry><id>1</id><price cur=\"eur\">10<c/></price></entry>"
+                              "<other/><entry k=\"2\"><price>20</price></entry></feed>")
+                ERROR("Wrong filtered DOM: %s", out.str().c_str());
+
+            p.get_root()->last_child()->check_attrib("k", "2")->first_child()->check_name("price");
+            if (p.get_root()->last_child()->line != 4)
+                ERROR("Wrong line after skipped elements");
+            DUMP("Ok.");
+        }
+
+        // Test record mode
+        {
+            DUMP("Check record mode");
+            XmlGrammar g;
+            std::string input = "<root>";
+            for (int i = 1; i <= 100; ++i)
+            {
+                std::ostringstream oss;
+                oss << "<r id=\"" << i << "\"><price>" << i << "</price><x/></r>";
+                input += oss.str();
+            }
+            input += "</root>";
+
+            XmlNode * kept;
+            {
+                RecordSum p(g);
+                p.set_record_depth(2);
+                p.parse(input.c_str());
+                if (p.count != 100 || p.sum != 5050 || p.get_root()->_first_child ||
+                    p.kept->get_attrib<int>("id") != 100 || p.kept->_parent)
+                    ERROR("Wrong records");
+                kept = p.kept;
+                p.kept = 0;
+            }
+
+            // The record outlives its parser
+            if (kept->get_name() != "r" || kept->get_attrib<int>("id") != 100 || kept->parser ||
+                kept->first_child()->get_name() != "price" || kept->first_child()->parser)
+                ERROR("Wrong record after the parser");
+            try
+            {
+                kept->check_name("s");
+                ERROR("Wrong record name accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Record error caught: %s", e.what());
+            }
+            delete kept;
+
+            XmlDomParser p2(g);
+            p2.set_record("price");
+            p2.parse(input.c_str());
+            if (p2.get_root()->first_child()->first_child()->check_name("x")->_next_sibling)
+                ERROR("Records left in the DOM");
+            DUMP("Ok.");
+        }
+
+        // Test two-stage parsing
+        {
+            DUMP("Check structural index");
+            XmlGrammar g;
+            std::string input = "<root a='single \"quoted\"' b=\"x &amp; y\">\n<!-- comment\n-- with > inside -->\n";
+            for (int i = 0; i < 20; ++i)
+                input += "<item id=\"long attribute value, long enough to cross index words\">"
+                         "long text with an &lt;escaped&gt; tag\n and a line break"
+                         "<![CDATA[raw <data> ]] here]]><?pi ? >?></item>\n";
+            input += "</root>";
+
+            std::ostringstream ref, out;
+            XmlDomParser p1(g);
+            p1.parse(input.c_str());
+            p1.get_root()->dump(ref);
+
+            XmlDomParser p2(g);
+            p2.set_structural_index(true);
+            p2.parse(input.c_str());
+            p2.get_root()->dump(out);
+            if (ref.str() != out.str() || p2.get_root()->get_attrib("a") != "single \"quoted\"")
+                ERROR("Different DOM with structural index");
+
+            int lines = 0;
+            const char * text = "abc\ndef\n\nghi&jkl";
+            if (xml_find(text, "<&", lines) != text + 12 || lines != 3)
+                ERROR("Wrong xml_find result");
+            DUMP("Ok.");
+        }
+
+        // Test text runs
+        {
+            DUMP("Check text runs");
+            XmlGrammar g;
+            std::string blanks(1000, ' ');
+            std::string input = "<a>x" + blanks + "&amp;  y \n\t <![CDATA[z]]>" + blanks + "\n</a>";
+            XmlDomParser p(g);
+            p.parse(input.c_str());
+            std::string d;
+            p.get_root()->first_child()->get_data(d);
+            if (d != "x" + blanks + "&  yz")
+                ERROR("Wrong text run");
+            DUMP("Ok.");
+        }
+
+        // Test references
+        {
+            DUMP("Check references");
+
+            // The table is built by its first users, concurrently
+            std::vector<EntityFinder> finders(4);
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < finders.size(); ++i)
+                threads.push_back(std::thread(& EntityFinder::run, & finders[i]));
+            for (size_t i = 0; i < threads.size(); ++i)
+                threads[i].join();
+            for (size_t i = 0; i < finders.size(); ++i)
+            {
+                if (finders[i].errors)
+                    ERROR("Wrong concurrent entity table");
+            }
+
+            XmlGrammar g;
+            const char * input = "<a b=\"&#65;&#x42;&lt;\">&#233;t&#xE9; &#x1F600; &eacute;&amp;&nbsp;</a>";
+            XmlDomParser p(g);
+            p.set_entities(& XmlEntityTable::html());
+            p.parse(input);
+            std::string d;
+            p.get_root()->first_child()->get_data(d);
+            if (p.get_root()->get_attrib("b") != "AB<" ||
+                d != "\xC3\xA9t\xC3\xA9 \xF0\x9F\x98\x80 \xC3\xA9&\xC2\xA0")
+                ERROR("Wrong decoding");
+
+            std::string buffer(input);
+            XmlDomParser p2(g);
+            p2.set_entities(& XmlEntityTable::html());
+            p2.parse_insitu(& buffer[0]);
+            p2.get_root()->first_child()->get_data(d);
+            if (d != "\xC3\xA9t\xC3\xA9 \xF0\x9F\x98\x80 \xC3\xA9&\xC2\xA0")
+                ERROR("Wrong in situ decoding");
+
+            XmlEntityTable custom;
+            custom.add("ell", "LL parser");
+            XmlDomParser p3(g);
+            p3.set_entities(& custom);
+            p3.parse("<a>&ell;</a>");
+            p3.get_root()->first_child()->get_data(d);
+            if (d != "LL parser" || XmlEntityTable::html().size() != 252)
+                ERROR("Wrong custom entity");
+            DUMP("Ok.");
+        }
+
+        // Test typed accessors
+        {
+            DUMP("Check typed accessors");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.parse("<a i=\" -42 \" u=\"4294967295\" d=\"-1.5e3\" f=\"0.1\" b=\"true\" s=\"x y\">12</a>");
+            XmlNode * root = p.get_root();
+
+            int i = 0, missing = 7, data = 0;
+            unsigned u = 0;
+            double d = 0;
+            float f = 0;
+            bool b = false;
+            std::string s;
+            root->get_attribs("i", i, "u", u, "d", d, "b", b)->get_attrib_if_present("f", f)
+                ->get_attrib_if_present("missing", missing)->get_attrib("s", s);
+            root->first_child()->get_data(data);
+            if (i != -42 || u != 4294967295u || d != -1500 || f != 0.1f || ! b || s != "x y" ||
+                missing != 7 || data != 12)
+                ERROR("Wrong typed values");
+
+            double big = 0, small = 0;
+            long long ll = 0;
+            if (! xml_convert("123456789012345678", big) || big != 123456789012345678.0 ||
+                ! xml_convert("1e-300", small) || small != 1e-300 ||
+                ! xml_convert("-9223372036854775808", ll) || ll != (-9223372036854775807LL - 1) ||
+                xml_convert("2147483648", i) || xml_convert("12px", i) || xml_convert("", d) ||
+                xml_convert("1.5.", d) || xml_convert("-1", u) || xml_convert("yes", b))
+                ERROR("Wrong conversions");
+
+            XmlAttributeRequest r[] = { xml_request("b", b), xml_request("z", i, false) };
+            root->get_attribs(r);
+            if (! r[0].found || r[1].found)
+                ERROR("Wrong request state");
+
+            try
+            {
+                root->get_attribs("i", i, "z", i);
+                ERROR("Missing attribute not detected");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Error caught: %s", e.what());
+            }
+            DUMP("Ok.");
+        }
+
+        // Test struct binding
+        {
+            DUMP("Check struct binding");
+            XmlGrammar g;
+            XmlBinding<Point> point;
+            point.attribute("x", & Point::x)
+                 .attribute("y", & Point::y);
+            XmlBinding<Shape> shape;
+            shape.attribute("name", & Shape::name)
+                 .attribute("closed", & Shape::closed)
+                 .text(& Shape::comment)
+                 .element("color", & Shape::color)
+                 .element("origin", & Shape::origin, point)
+                 .elements("point", & Shape::points, point)
+                 .elements("w", & Shape::weights);
+
+            Shape s;
+            XmlBinder binder(g);
+            binder.parse("<shape name=\"tri\" closed=\"true\" ignored=\"1\">triangle"
+                         "<color>red</color><unknown><point x=\"9\" y=\"9\"/></unknown>"
+                         "<origin x=\"-1\" y=\"-2\"/><point x=\"0\" y=\"0\"/><point x=\"1\" y=\"0\">"
+                         "<w>3</w></point><point x=\"0\" y=\"1\"/><w>0.5</w><w>2</w></shape>",
+                         "shape", shape, s);
+            if (s.name != "tri" || ! s.closed || s.comment != "triangle" || s.color != "red" ||
+                s.origin.x != -1 || s.origin.y != -2 || s.points.size() != 3 ||
+                s.points[1].x != 1 || s.points[2].y != 1 || s.weights.size() != 2 || s.weights[0] != 0.5)
+                ERROR("Wrong binding");
+
+            try
+            {
+                binder.parse("<shape><point x=\"a\"/></shape>", "shape", shape, s);
+                ERROR("Wrong type not detected");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Binding error caught: %s", e.what());
+            }
+
+            // Elements left open by the error are forgotten
+            s.points.clear();
+            binder.parse("<shape><point x=\"5\" y=\"6\"/></shape>", "shape", shape, s);
+            if (s.points.size() != 1 || s.points[0].y != 6)
+                ERROR("Wrong binding after an error");
+
+            // Parts of prefixed names are interned too, without binding
+            XmlBinding<Shape> prefixed;
+            prefixed.attribute("xlink:name", & Shape::name)
+                    .element("svg:color", & Shape::color)
+                    .element("origin", & Shape::origin, point);
+            Shape t;
+            XmlBinder prefixed_binder(g);
+            prefixed_binder.parse("<shape xlink:name=\"n\" name=\"m\"><svg:color>blue</svg:color><color>no</color>"
+                                  "<svg>no</svg><origin x=\"3\" y=\"4\"/></shape>",
+                                  "shape", prefixed, t);
+            if (t.name != "n" || t.color != "blue" || t.origin.x != 3 || t.origin.y != 4 ||
+                prefixed.find_child("svg") || prefixed.find_child("color") || prefixed.find_attribute("name"))
+                ERROR("Wrong prefixed binding");
+            DUMP("Ok.");
+        }
+
+        // Test snapshots
+        {
+            DUMP("Check snapshots");
+            const char * input = "<a x=\"1\">text &amp; more<b y=\"&lt;\"/><!-- c --><c>d</c></a>";
+            const char * source = "xml_test_snapshot.xml", * path = "xml_test_snapshot.tape";
+            {
+                std::ofstream f(source);
+                f << input;
+            }
+
+            XmlGrammar g;
+            XmlDomParser dom(g);
+            dom.parse(input);
+            XmlTapeParser p(g);
+            std::string buffer(input);
+            p.parse_insitu(& buffer[0]);
+            XmlTape copy(p.tape);
+            if (! XmlSnapshot::save(copy, path, source))
+                ERROR("Cannot save snapshot");
+
+            XmlSnapshot s;
+            if (! s.open(path, source) || ! is_equal(s.get_root(), * dom.get_root()))
+                ERROR("Wrong snapshot");
+            s.close();
+
+            {
+                std::ofstream f(source, std::ios::app);
+                f << ' ';
+            }
+            if (s.open(path, source))
+                ERROR("Out of date snapshot accepted");
+
+            XmlSnapshot::save(p.tape, path, source);
+            {
+                std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+                f.seekp(40);
+                f.put('\x7F');
+            }
+            if (s.open(path, source))
+                ERROR("Corrupted snapshot accepted");
+
+            // The header checksum does not cover the body: links and string
+            // ranges out of bounds must be caught too
+            const size_t record = sizeof(XmlSnapshotHeader) + sizeof(XmlTape::Record);
+            const size_t corrupted[] = { record + offsetof(XmlTape::Record, next_sibling),
+                                         record + offsetof(XmlTape::Record, last_child),
+                                         record + offsetof(XmlTape::Record, attributes),
+                                         record + offsetof(XmlTape::Record, text) };
+            for (size_t i = 0; i < sizeof corrupted / sizeof * corrupted; ++i)
+            {
+                XmlSnapshot::save(p.tape, path, source);
+                {
+                    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+                    f.seekp(corrupted[i]);
+                    f.write("\x7F\x7F\x7F\x7F", 4);
+                }
+                if (s.open(path, source))
+                    ERROR("Snapshot with corrupted body accepted");
+            }
+
+            XmlSnapshot::save(p.tape, path, source);
+            if (! s.open(path, source))
+                ERROR("Valid snapshot rejected");
+            s.close();
+
+            remove(source);
+            remove(path);
+            DUMP("Ok.");
+        }
+
+        // Test subtree hashes and diff
+        {
+            DUMP("Check subtree hashes and diff");
+            XmlGrammar g;
+            XmlDomParser p1(g), p2(g), p3(g);
+            p1.parse("<a x=\"1\" y=\"2\"><b>t</b><c z=\"3\"/><d/><e><f>u</f></e></a>");
+            p2.parse("<a y=\"2\" x=\"1\"><b>t</b><c z=\"3\"/><d/><e><f>u</f></e></a>");
+            p3.parse("<a x=\"1\" y=\"2\"><new/><b>t</b><d/><e><f>v</f></e><g/></a>");
+            XmlNode * a1 = p1.get_root(), * a2 = p2.get_root();
+
+            uint64_t h = a1->hash();
+            if (h != a2->hash() || h == p3.get_root()->hash())
+                ERROR("Wrong subtree hashes");
+
+            XmlNode * f = a1->last_child()->first_child();
+            f->first_child()->set_data("v");
+            if (a1->hash() == h || f->hash() == a2->last_child()->first_child()->hash())
+                ERROR("Hash not invalidated by set_data");
+            f->first_child()->set_data("u");
+            XmlNode * n = a1->enqueue_child(new XmlNode);
+            n->set_name("n");
+            if (a1->hash() == h)
+                ERROR("Hash not invalidated by enqueue_child");
+            delete n->detach();
+            if (a1->hash() != h || ! a1->is_equal(* a2))
+                ERROR("Hash not restored");
+
+            std::vector<XmlDifference> diff;
+            xml_diff(* a1, * a2, diff);
+            if (! diff.empty())
+                ERROR("Differences between identical trees");
+
+            // Attribute names and values must not run together
+            XmlDomParser q1(g), q2(g);
+            q1.parse("<x ab=\"c\"/>");
+            q2.parse("<x a=\"bc\"/>");
+            xml_diff(* q1.get_root(), * q2.get_root(), diff);
+            if (q1.get_root()->hash() == q2.get_root()->hash() || diff.size() != 1)
+                ERROR("Attribute name and value not separated in hashes");
+            diff.clear();
+
+            // An empty element and a data node of the same text collide:
+            // equal hashes must not hide the difference
+            XmlDomParser c1(g), c2(g);
+            c1.parse("<r><x/></r>");
+            c2.parse("<r>x</r>");
+            xml_diff(* c1.get_root(), * c2.get_root(), diff);
+            if (diff.size() != 2)
+                ERROR("Colliding hashes taken for identical subtrees");
+            diff.clear();
+
+            xml_diff(* a1, * p3.get_root(), diff);
+            std::ostringstream oss;
+            for (size_t i = 0; i < diff.size(); ++i)
+            {
+                const XmlDifference & d = diff[i];
+                oss << "CID"[d.kind] << ':'
+                    << (d.kind == XmlDifference::INSERTED ? d.new_node : d.old_node)->describe() << ';';
+            }
+            DUMP("%s", oss.str().c_str());
+            if (oss.str() != "I:1: Element `new`;D:1: Element `c` z=3;C:1: Data \"u\";I:1: Element `g`;")
+                ERROR("Wrong differences");
+            DUMP("Ok.");
+        }
+
+        // Test incremental reparse
+        {
+            DUMP("Check incremental reparse");
+            XmlGrammar g;
+            std::string text = "<root>\n <a x=\"1\">\n  <b>old</b>\n </a>\n <c\n  y=\"2\">text</c>\n</root>";
+            XmlDomParser p(g);
+            p.parse(text.c_str());
+            if (p.get_root()->source_begin != 0 || p.get_root()->source_end != text.size() ||
+                text.substr(p.get_root()->last_child()->source_begin, 3) != "<c\n")
+                ERROR("Wrong source positions");
+
+            struct Edit
+            {
+                const char * from, * to;
+                bool local;
+            } edits[] = {
+                { "old", "new\nlines", true },
+                { "x=\"1\"", "x=\"3\" z=\"&lt;\"", true },
+                { "text", "<d/>\n<e>f</e>", true },
+                { "<d/>", "</c>\n<c>", false },
+                { "<root>", "<root\n>", false },
+            };
+
+            for (size_t k = 0; k < sizeof edits / sizeof edits[0]; ++k)
+            {
+                size_t begin = text.find(edits[k].from), end = begin + strlen(edits[k].from);
+                XmlNode * r = p.reparse(text.c_str(), begin, end, edits[k].to);
+                text.replace(begin, end - begin, edits[k].to);
+
+                XmlDomParser full(g);
+                full.parse(text.c_str());
+                if (! p.get_root()->is_equal(* full.get_root()) || ! same_positions(p.document, full.document))
+                    ERROR("Wrong DOM after edit %d", (int) k);
+                if (edits[k].local == (r == p.get_root()))
+                    ERROR("Edit %d not local", (int) k);
+            }
+
+            try
+            {
+                p.reparse(text.c_str(), text.find("f</e>"), text.find("f</e>") + 1, "</x>");
+                ERROR("Invalid edit accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Reparse error caught: %s", e.what());
+            }
+
+            // A truncated end tag fails on the missing '>', the whole
+            // document being parsed again
+            try
+            {
+                p.reparse(text.c_str(), text.size() - 1, text.size(), "");
+                ERROR("Truncated end tag accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Reparse error caught: %s", e.what());
+            }
+            if (p.get_root()->source_end != text.size())
+                ERROR("DOM changed by a failed reparse");
+            DUMP("Ok.");
+        }
+
+        // Test child index
+        {
+            DUMP("Check child index");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.parse("<root><a/><b/><c/><d/></root>");
+            XmlNode * root = p.get_root();
+            if (root->child_count() != 4 || root->child_at(2)->get_name() != "c" ||
+                root->child_at(3)->index_in_parent() != 3 ||
+                (* (root->first() + 3))->get_name() != "d" || (* (root->last() - 3))->get_name() != "a" ||
+                root->first() + 4 || root->last() - 4 || root->first() + -1)
+                ERROR("Wrong child index");
+
+            root->enqueue_child(new XmlNode)->set_name("e");
+            delete root->child_at(1)->detach();
+            delete root->first_child()->next_sibling()->detach();
+            root->last_child()->insert_sibling_node_before(new XmlNode)->set_name("f");
+
+            std::string names;
+            XmlNodeRange r = root->children();
+            for (XmlNode * const * i = r.begin; i != r.end; ++i)
+                names += (* i)->get_name() + char('0' + (* i)->index_in_parent());
+            DUMP("%s", names.c_str());
+            if (names != "a0d1f2e3" || r.size() != root->child_count() || r[3] != root->last_child())
+                ERROR("Wrong child index after changes");
+
+            try
+            {
+                root->child_at(4);
+                ERROR("Missing child accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Child index error caught: %s", e.what());
+            }
+            if (root->first_child()->child_count() != 0 || ! root->first_child()->children().empty())
+                ERROR("Wrong leaf index");
+
+            // Without index, iterators walk the siblings
+            XmlDomParser walked(g);
+            walked.parse("<root>\n<a/>\n<b/>\n<c/>\n<d/>\n</root>");
+            std::vector<SiblingStepper> steppers(2, SiblingStepper(walked.get_root()));
+            std::vector<std::thread> walkers;
+            for (size_t i = 0; i < steppers.size(); ++i)
+                walkers.push_back(std::thread(& SiblingStepper::run, & steppers[i]));
+            for (size_t i = 0; i < walkers.size(); ++i)
+                walkers[i].join();
+            for (size_t i = 0; i < steppers.size(); ++i)
+            {
+                if (steppers[i].errors)
+                    ERROR("Wrong concurrent iterator arithmetic");
+            }
+
+            // Built before sharing, the index is only read by threads
+            XmlDomParser shared(g);
+            shared.parse("<root><a><x/><y>t</y></a><b/><c><z><w/></z></c>text</root>");
+            shared.get_root()->build_index();
+            std::vector<IndexReader> readers(4, IndexReader(shared.get_root()));
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < readers.size(); ++i)
+                threads.push_back(std::thread(& IndexReader::run, & readers[i]));
+            for (size_t i = 0; i < threads.size(); ++i)
+                threads[i].join();
+            for (size_t i = 0; i < readers.size(); ++i)
+            {
+                if (readers[i].errors)
+                    ERROR("Wrong concurrent child index");
+            }
+            DUMP("Ok.");
+        }
+
+        // Test parallel visitor
+        {
+            DUMP("Check parallel visitor");
+            std::string text = "<root>";
+            for (int i = 0; i < 40; ++i)
+            {
+                text += "<a>";
+                for (int j = 0; j < i; ++j)
+                    text += "<b><c>x</c></b>";
+                text += "</a>";
+            }
+            text += "</root>";
+
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.parse(text.c_str());
+
+            std::vector<XmlVisitTask> tasks;
+            xml_partition(p.get_root(), 30, tasks);
+            DUMP("%d tasks", (int) tasks.size());
+            if (tasks.size() < 10 || tasks.front().kind != XmlVisitTask::ENTER || tasks.front().first != p.get_root() ||
+                tasks.back().kind != XmlVisitTask::LEAVE || tasks.back().first != p.get_root())
+                ERROR("Wrong partition");
+
+            // Small siblings are packed
+            std::string flat = "<root>";
+            for (int i = 0; i < 2000; ++i)
+                flat += "<r/>";
+            flat += "</root>";
+            XmlDomParser f(g);
+            f.parse(flat.c_str());
+            tasks.clear();
+            xml_partition(f.get_root(), 100, tasks);
+            if (tasks.size() != 22 || tasks[1].kind != XmlVisitTask::SUBTREES || tasks[1].count != 100)
+                ERROR("Small siblings not packed");
+
+            // The reduction is order sensitive: the result must be the sequential one
+            std::string sequential = NameLister(1, 1000000).process(p.get_root());
+            if (sequential.compare(0, 9, "root a /a") != 0)
+                ERROR("Wrong sequential visit");
+            for (size_t workers = 1; workers <= 8; workers *= 2)
+            {
+                for (int k = 0; k < 10; ++k)
+                {
+                    if (NameLister(workers, 30).process(p.get_root()) != sequential ||
+                        NameLister(workers, 3).process(f.get_root()) != NameLister(1, 100000).process(f.get_root()))
+                        ERROR("Parallel visit not in document order with %d workers", (int) workers);
+                }
+            }
+
+            p.get_root()->last_child()->first_child()->set_name("bad");
+            try
+            {
+                NameLister(4, 30).process(p.get_root());
+                ERROR("Visitor error lost");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Visitor error caught: %s", e.what());
+            }
+            DUMP("Ok.");
+        }
+
+        // Test frozen documents
+        {
+            DUMP("Check frozen documents");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.parse("<root a=\"1\"><x><y>text</y></x><z b=\"2\"/>end</root>");
+
+            XmlFrozenRef v1 = xml_freeze(p.get_root());
+            XmlNode * thawed = v1->thaw(p.names);
+            if (! thawed->is_equal(* p.get_root()) || thawed->name != p.get_root()->name ||
+                thawed->name.table() != & p.names || v1->child_count() != 3 ||
+                v1->child_at(1)->get_attrib<int>("b") != 2 || v1->child_at(2)->get_data() != "end")
+                ERROR("Wrong frozen copy");
+            delete thawed;
+
+            // Same printer as the DOM
+            {
+                XmlFrozenRef special = v1->with_attrib("q", "<\"&'>");
+                thawed = special->thaw(p.names);
+                std::ostringstream frozen, dom;
+                special->unparse(frozen, 1, 2);
+                thawed->unparse(dom, 1, 2);
+                delete thawed;
+                if (frozen.str() != dom.str() || frozen.str().find("q=\"&lt;&quot;&amp;&apos;&gt;\"") == std::string::npos)
+                    ERROR("Wrong frozen output: %s", frozen.str().c_str());
+            }
+
+            // Threads thaw the same frozen tree, each in its own table
+            {
+                std::ostringstream expected;
+                p.get_root()->unparse(expected);
+                std::vector<FrozenThawer> thawers(4, FrozenThawer(v1, expected.str()));
+                std::vector<std::thread> threads;
+                for (size_t i = 0; i < thawers.size(); ++i)
+                    threads.push_back(std::thread(& FrozenThawer::run, & thawers[i]));
+                for (size_t i = 0; i < threads.size(); ++i)
+                    threads[i].join();
+                for (size_t i = 0; i < thawers.size(); ++i)
+                {
+                    if (thawers[i].errors)
+                        ERROR("Wrong concurrent thaw");
+                }
+            }
+
+            std::vector<size_t> path;
+            path.push_back(0);
+            path.push_back(0);
+            XmlFrozenRef v2 = v1->replace(path, v1->child_at(0)->child_at(0)->with_attrib("c", "3"));
+            path.resize(1);
+            XmlFrozenRef v3 = v2->insert(path, XmlFrozenNode::data_node("begin"));
+            path[0] = 3;
+            v3 = v3->replace(path, XmlFrozenRef());
+
+            std::ostringstream oss;
+            oss << * v3;
+            DUMP("%s", oss.str().c_str());
+            if (v1->child_at(0)->child_at(0)->has_attrib("c") || v3->child_count() != 3 ||
+                v3->child_at(1)->child_at(0)->get_attrib("c") != "3" ||
+                v3->child_at(2) != v1->child_at(1) ||
+                v2->child_at(0)->child_at(0)->child_at(0) != v1->child_at(0)->child_at(0)->child_at(0))
+                ERROR("Wrong structural sharing");
+
+            try
+            {
+                path[0] = 3;
+                v3->replace(path, v1);
+                ERROR("Missing child accepted");
+            }
+            catch (std::runtime_error & e)
+            {
+                DUMP("Frozen node error caught: %s", e.what());
+            }
+
+            // Readers run while versions are published
+            XmlFrozenNode::Children children(1, XmlFrozenNode::element("item", XmlFrozenNode::Attributes(1, std::make_pair("i", "0"))));
+            XmlFrozenDocument document(XmlFrozenNode::element("list", XmlFrozenNode::Attributes(1, std::make_pair("n", "0")), children));
+            std::vector<FrozenReader> readers(4, FrozenReader(document));
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < readers.size(); ++i)
+                threads.push_back(std::thread(& FrozenReader::run, & readers[i]));
+            for (int n = 1; n <= 100; ++n)
+            {
+                std::ostringstream i;
+                i << n;
+                XmlFrozenRef r = document.acquire()->with_attrib("n", i.str());
+                path[0] = n;
+                document.publish(r->insert(path, XmlFrozenNode::element("item", XmlFrozenNode::Attributes(1, std::make_pair("i", i.str())))));
+            }
+            for (size_t i = 0; i < threads.size(); ++i)
+                threads[i].join();
+            for (size_t i = 0; i < readers.size(); ++i)
+            {
+                if (readers[i].errors)
+                    ERROR("Inconsistent version read");
+            }
+            document.collect();
+            if (document.acquire()->child_count() != 101)
+                ERROR("Wrong last version");
+            DUMP("Ok.");
+        }
+
+        // Test clone and transfer
+        {
+            DUMP("Check clone and transfer");
+            XmlGrammar g;
+            XmlDomParser a(g), b(g);
+            a.parse("<root><item k=\"1\" v=\"x\"><sub>text</sub></item><item k=\"2\"/></root>");
+            b.parse("<other><item k=\"0\"/></other>");
+
+            uint64_t h = a.get_root()->hash();
+            XmlNode * copy = a.get_root()->clone();
+            if (! copy->is_equal(* a.get_root()) || copy->hash() != h ||
+                copy->name != a.get_root()->name || copy->parser != & a)
+                ERROR("Wrong clone");
+            delete copy;
+
+            copy = a.get_root()->first_child()->clone(& b, & b.names);
+            if (copy->name != b.get_root()->first_child()->name || copy->name.table() != & b.names ||
+                copy->attributes.begin()->first != b.get_root()->first_child()->attributes.begin()->first ||
+                copy->first_child()->name.table() != & b.names)
+                ERROR("Names not interned in the target table");
+            b.get_root()->enqueue_child(copy);
+
+            XmlNode * moved = a.get_root()->last_child()->transfer(& b, b.names);
+            b.get_root()->first_child()->insert_sibling_node_before(moved);
+            if (a.get_root()->child_count() != 1 || b.get_root()->child_count() != 3 ||
+                moved->name.table() != & b.names || moved->parser != & b ||
+                moved->attributes.begin()->first.table() != & b.names)
+                ERROR("Wrong transfer");
+
+            std::ostringstream oss;
+            oss << * b.get_root();
+            DUMP("%s", oss.str().c_str());
+            XmlDomParser c(g);
+            c.parse(oss.str().c_str());
+            if (! c.get_root()->is_equal(* b.get_root()))
+                ERROR("Wrong document after transfer");
+            DUMP("Ok.");
+        }
+
+        // Test namespaces
+        {
+            DUMP("Check namespaces");
+            XmlGrammar g;
+            XmlDomParser p(g);
+            p.set_namespace_mode(true);
+            std::string text = "<a:root xmlns:a=\"urn:a\" xmlns=\"urn:d\">"
+                               "<item a:k=\"1\" k=\"2\" xml:lang=\"en\"/>"
+                               "<b:item xmlns:b=\"urn:a\" b:k=\"3\"><inner xmlns=\"\"/></b:item>"
+                               "</a:root>";
+            p.parse(text.c_str());
+
+            XmlName ua = p.names.find("urn:a"), ud = p.names.find("urn:d"), item = p.names.find("item"),
+                    k = p.names.find("k");
+            XmlNode * root = p.get_root(), * first = root->first_child(), * second = root->last_child();
+            if (! root->is_named(ua, p.names.find("root")) || ! first->is_named(ud, item) ||
+                ! second->is_named(ua, item) || second->name == first->name ||
+                ! second->first_child()->ns.empty() || first->get_namespaces() != root->get_namespaces())
+                ERROR("Wrong element namespaces");
+
+            if (first->get_attrib_ns(ua, k) != "1" || first->get_attrib_ns(XmlName(), k) != "2" ||
+                second->get_attrib_ns(ua, k) != "3" || second->has_attrib_ns(XmlName(), k) ||
+                first->get_attrib_ns(p.names.find("http://www.w3.org/XML/1998/namespace"), p.names.find("lang")) != "en")
+                ERROR("Wrong attribute namespaces");
+
+            // Reparse and clone keep scopes
+            size_t b = text.find("k=\"2\""), e = b + 5;
+            XmlNode * r = p.reparse(text.c_str(), b, e, "k=\"4\"");
+            if (r == p.get_root() || ! r->is_named(ud, item) || r->get_attrib_ns(XmlName(), k) != "4")
+                ERROR("Wrong namespaces after reparse");
+
+            XmlNameTable other;
+            XmlNode * copy = p.get_root()->clone(0, & other);
+            if (! copy->last_child()->is_named(other.find("urn:a"), other.find("item")) ||
+                copy->last_child()->get_attrib_ns(other.find("urn:a"), other.find("k")) != "3")
+                ERROR("Wrong namespaces after clone");
+            delete copy;
+
+            const char * wrong[] = { "<a:root/>", "<root a:x=\"1\"/>", "<root xmlns:a=\"\"/>" };
+            for (size_t i = 0; i < sizeof wrong / sizeof wrong[0]; ++i)
+            {
+                try
+                {
+                    p.parse(wrong[i]);
+                    ERROR("Namespace error not detected: %s", wrong[i]);
+                }
+                catch (std::runtime_error & e)
+                {
+                    DUMP("Namespace error caught: %s", e.what());
+                }
+            }
+            DUMP("Ok.");
+        }
+
+        // Test content model validation
+        {
+            DUMP("Check content model validation");
+            XmlSchema schema;
+            schema.element("book", "(title, author+, (chapter | appendix)*, note?)");
+            schema.element("title", "(#PCDATA)");
+            schema.element("author", "EMPTY");
+            schema.element("chapter", "(#PCDATA | em)*");
+            schema.element("appendix", "ANY");
+            schema.element("note", "(#PCDATA)");
+            schema.element("em", "(#PCDATA)");
+            schema.require_attribute("author", "name");
+            schema.set_root("book");
+
+            const XmlContentModel * book = schema.model(schema.names.find("book"));
+            DUMP("%d states", (int) book->accepting.size());
+            if (! book || book->accepting.size() != 6 || book->accepting[0] || schema.model(schema.names.find("nothing")))
+                ERROR("Wrong content model");
+
+            XmlGrammar g;
+            const char * valid =
+                "<book>\n"
+                " <title>T</title>\n"
+                " <author name=\"a\"/><author name=\"b\"/>\n"
+                " <chapter>Some <em>text</em></chapter>\n"
+                " <appendix><em>x</em><title>y</title></appendix>\n"
+                " <chapter/>\n"
+                "</book>";
+            XmlValidator v(g, schema);
+            v.parse(valid);
+
+            XmlValidating<XmlDomParser> d(g, schema);
+            d.parse(valid);
+            if (d.get_root()->child_count() != 6)
+                ERROR("Wrong validated DOM");
+
+            const char * wrong[] = {
+                "<book><author name=\"a\"/></book>",
+                "<book><title/></book>",
+                "<book><title/><author name=\"a\"/><note/><chapter/></book>",
+                "<book><title/><author/></book>",
+                "<book><title/><author name=\"a\">text</author></book>",
+                "<book>text<title/><author name=\"a\"/></book>",
+                "<title/>",
+                "<book><title/><author name=\"a\"/><other/></book>",
+            };
+            for (size_t i = 0; i < sizeof wrong / sizeof wrong[0]; ++i)
+            {
+                try
+                {
+                    v.parse(wrong[i]);
+                    ERROR("Invalid document accepted: %s", wrong[i]);
+                }
+                catch (std::runtime_error & e)
+                {
+                    DUMP("Validation error caught: %s", e.what());
+                }
+            }
+
+            const char * models[] = { "(a,b", "(a|b,c)", "EMPTY*", "(#PCDATA|a)+" };
+            for (size_t i = 0; i < sizeof models / sizeof models[0]; ++i)
+            {
+                try
+                {
+                    schema.element("wrong", models[i]);
+                    ERROR("Invalid content model accepted: %s", models[i]);
+                }
+                catch (std::runtime_error & e)
+                {
+                    DUMP("Content model error caught: %s", e.what());
+                }
+            }
+            DUMP("Ok.");
+        }
+
+        // Test zero-copy SAX
+        {
+            DUMP("Check zero-copy SAX");
+            XmlGrammar g;
+            const char * input = "<a b=\"c\" d=\"&lt;e\">f<g>h &amp; i</g></a>";
+            ViewChecker p(g, input);
+
+            p.parse(input);
+            if (p.slices != 8 || p.decoded != 2)
+                ERROR("%d slices and %d decoded strings", p.slices, p.decoded);
+            DUMP("Ok.");
+        }
+
+        // Test compact DOM walking
+        {
+            DUMP("Check compact DOM walking");
+            XmlGrammar g;
+            XmlTapeParser p(g);
+
+            p.parse("<racine a=\"1\" b=\"2\"><hello/><you><deep /></you>hi<How do=\"you\">do</How></racine>");
+            XmlTapeNode root = p.get_root();
+            root.check_name("racine").check_attrib("b", "2");
+            if (root.get_attrib<int>("a") != 1)
+                ERROR("Wrong attribute value");
+
+            XmlTapeIterator i = root.last();
+            (* i).check_name("How").first_child().check_data("do");
+            (* --i).check_data("hi");
+            (* (i - 2)).check_name("hello");
+            root.first_child().next_sibling().check_name("you")
+                .first_child().check_name("deep")
+                .parent().parent().check_name("racine");
+            DUMP("Ok.");
+        }
     }
     catch(std::exception &e)
     {